@@ -3,9 +3,15 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "third_party/stb_image.h"
 
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STBI_WRITE_NO_STDIO
+#include "third_party/stb_image_write.h"
+
 #define DR_WAV_IMPLEMENTATION
 #include "third_party/dr_wav.h"
 
+#include "simd.cpp"
+
 struct Asset_Info
 {
     String name;
@@ -31,6 +37,49 @@ struct Font_Asset
     Font font;
 };
 
+#define MIX_LIMITER_RELEASE_SECONDS 0.25
+
+#define MIX_VOICE_COUNT 32
+// NOTE(nick): envelopes are stepped once per block and ramped linearly in between
+#define MIX_VOICE_BLOCK_SIZE 32
+
+#define WAVETABLE_BITS 11
+#define WAVETABLE_SIZE (1 << WAVETABLE_BITS)
+// NOTE(nick): octave i holds the harmonics that stay under nyquist for tones up to
+// WAVETABLE_BASE_HZ << (i + 1)
+#define WAVETABLE_OCTAVE_COUNT 10
+#define WAVETABLE_BASE_HZ 20
+#define WAVETABLE_SAMPLE_RATE 44100
+#define NOISE_TABLE_BITS 16
+
+typedef u32 Envelope_Stage;
+enum {
+    Envelope_Off = 0,
+    Envelope_Attack,
+    Envelope_Decay,
+    Envelope_Sustain,
+    Envelope_Release,
+};
+
+struct Mix_Voice
+{
+    u32 generation;
+    b32 active;
+
+    Waveform waveform;
+    f32 tone_hz;
+    f32 volume;
+    // NOTE(nick): 32-bit phase accumulator, a full turn of the phase reads through the table once
+    u32 phase;
+
+    Envelope envelope;
+    Envelope_Stage stage;
+    f32 level;
+    f32 release_rate;
+    // NOTE(nick): volume * level at the end of the last block rendered
+    f32 gain;
+};
+
 struct Playing_Sound
 {
     Sound sound;
@@ -45,6 +94,324 @@ struct Playing_Sound_Array
     i64 count;
 };
 
+// NOTE(nick): has to be a power of two
+#define MIX_COMMAND_QUEUE_SIZE 1024
+
+typedef u32 Mix_Command_Type;
+enum {
+    MixCommand_PlaySound = 0,
+    MixCommand_SetMasterVolume,
+    MixCommand_SetLimiter,
+    MixCommand_PlayMusic,
+    MixCommand_PauseMusic,
+    MixCommand_VoiceStart,
+    MixCommand_VoiceStop,
+    MixCommand_VoiceSetTone,
+    MixCommand_VoiceSetVolume,
+};
+
+struct Mix_Command
+{
+    Mix_Command_Type type;
+
+    Sound sound;
+    Music music;
+    Voice voice;
+    Waveform waveform;
+    Envelope envelope;
+    f32 tone_hz;
+    f32 value;
+};
+
+#define MUSIC_SLOT_COUNT 8
+// NOTE(nick): each half of the window, about 370ms at 44100
+#define MUSIC_WINDOW_FRAMES 16384
+
+typedef u64 Music_Buffer_State;
+enum {
+    MusicBuffer_Empty = 0,
+    MusicBuffer_Decoding,
+    MusicBuffer_Ready,
+};
+
+//
+// NOTE(nick): streamed music
+//
+// The window is two buffers that the decode thread fills in turn and the mixer plays in the same
+// turn. The decode thread marks a buffer ready once it's filled and the mixer marks it empty again
+// once it has played all of it, then wakes the decode thread up to fill it again. The buffer states
+// and the rewind flag are the only things the two of them share, the decoder itself only ever runs
+// on the decode thread.
+// It's kept off the work queue so the draw and particle jobs never wait on file reads.
+//
+
+struct Music_Stream
+{
+    u64 volatile open;
+    u64 hash;
+    drwav wav;
+
+    i16 *buffers[2];
+    u32 buffer_frames[2];
+    b32 buffer_is_last[2];
+    Music_Buffer_State volatile buffer_states[2];
+
+    // NOTE(nick): set by the mixer, taken by the decode thread
+    u64 volatile rewind_pending;
+
+    // NOTE(nick): game thread
+    b32 volatile looping;
+
+    // NOTE(nick): decode thread
+    u32 next_decode_buffer;
+    b32 at_end;
+
+    // NOTE(nick): mixer
+    b32 playing;
+    f32 volume;
+    u32 play_buffer;
+    u32 play_offset;
+    b32 finished;
+    // NOTE(nick): played again while its last buffer was playing, so it starts over instead of ending
+    b32 restart_pending;
+};
+
+//
+// NOTE(nick): mixer
+//
+// The game thread never touches the mixer's state directly, every Mixer* and Voice* call is pushed
+// onto a single producer, single consumer command queue that's drained right before each block is
+// mixed. That lets the platform mix on its own audio thread (see GameMixAudio) with no locks. When
+// it doesn't, GameEndFrame mixes on the game thread and the queue is drained there instead.
+//
+
+struct Mixer
+{
+    Mix_Command commands[MIX_COMMAND_QUEUE_SIZE];
+    u64 volatile command_write_index;
+    u64 volatile command_read_index;
+
+    // NOTE(nick): only touched by the thread that mixes
+    Playing_Sound_Array playing_sounds;
+    f32 master_volume;
+    b32 limiter;
+    f32 limiter_gain;
+    Mix_Voice voices[MIX_VOICE_COUNT];
+
+    f32 *bus;
+    i64 bus_capacity;
+
+    // NOTE(nick): written by the thread that mixes for VoiceStart and VoiceIsPlaying to read, the last
+    // generation of each voice that went silent and how loud each voice is
+    u32 volatile voice_done[MIX_VOICE_COUNT];
+    f32 volatile voice_gain[MIX_VOICE_COUNT];
+};
+
+//
+// NOTE(nick): deferred drawing
+//
+// Between DrawBeginDeferred and DrawEndDeferred the Draw* calls don't touch any pixels. Instead
+// they are recorded into a command buffer and binned into DRAW_TILE_SIZE screen tiles by their
+// bounds. DrawEndDeferred then rasterizes the tiles in parallel on the work queue, replaying each
+// tile's commands in the order they were recorded with the clip rect set to the tile (intersected
+// with the clip rect the command was recorded with).
+//
+
+#define DRAW_TILE_SIZE 32
+
+#define DRAW_CLIP_STACK_SIZE 64
+
+#define DRAW_TARGET_STACK_SIZE 8
+#define DRAW_TARGET_SPANS_COUNT 64
+
+typedef u32 Draw_Command_Type;
+enum {
+    DrawCommand_Pixel = 0,
+    DrawCommand_Rect,
+    DrawCommand_RectExt,
+    DrawCommand_Ellipse,
+    DrawCommand_Triangle,
+    DrawCommand_TriangleExt,
+    DrawCommand_Line,
+    DrawCommand_Image,
+    DrawCommand_ImageExt,
+    DrawCommand_Clear,
+};
+
+// NOTE(nick): channels of a premultiplied color in 16.16 fixed point, 0 to 255
+struct Gradient_Color
+{
+    i32 e[4];
+};
+
+// NOTE(nick): commands are only allocated up to the end of their union member. Colors are stored
+// the way the rasterizers take them, already premultiplied for the command's blend mode.
+struct Draw_Command
+{
+    Draw_Command_Type type;
+    Blend_Mode blend_mode;
+    Rectangle2i clip;
+
+    union
+    {
+        struct { Vector2 pos; u32 color; } pixel;
+        struct { Rectangle2 rect; u32 color; } rect;
+        struct { Rectangle2 rect; Gradient_Color c0, c1, c2, c3; } rect_ext;
+        struct { Vector2 pos; Vector2 radius; u32 color; f32 thickness; b32 anti_aliased; } ellipse;
+        struct { Vector2 p0, p1, p2; u32 color; } triangle;
+        struct { Vector2 p0, p1, p2; Gradient_Color c0, c1, c2; } triangle_ext;
+        struct { Vector2 p0, p1; u32 color; b32 include_last; } line;
+        struct { Image image; Vector2 pos; } image;
+        struct { Image image; Rectangle2 rect; Vector4 color; Rectangle2 uv; } image_ext;
+        struct { u32 color; } clear;
+    };
+};
+
+#define DRAW_BIN_CHUNK_SIZE 64
+
+struct Draw_Bin_Chunk
+{
+    Draw_Bin_Chunk *next;
+    i64 count;
+    Draw_Command *commands[DRAW_BIN_CHUNK_SIZE];
+};
+
+struct Draw_Tile
+{
+    Rectangle2i rect;
+    Draw_Bin_Chunk *first;
+    Draw_Bin_Chunk *last;
+};
+
+struct Draw_State
+{
+    Blend_Mode blend_mode;
+
+    // NOTE(nick): pixels outside of the clip rect are never touched, max is exclusive
+    Rectangle2i clip;
+
+    b32 deferred;
+
+    // NOTE(nick): set while replaying the commands of a deferred tile
+    b32 in_tile;
+};
+
+// NOTE(nick): cached text layouts are thrown out all at once when either of these fill up
+#define TEXT_CACHE_SIZE Megabytes(8)
+#define TEXT_CACHE_SLOT_COUNT 4096
+
+struct Text_Glyph
+{
+    Rectangle2 rect;
+    Rectangle2 uv;
+};
+
+struct Text_Layout
+{
+    u64 hash;
+    Font_Glyph *glyphs_key;
+    Vector2i image_size;
+    f32 max_width;
+    String text;
+
+    Text_Glyph *glyphs;
+    i64 glyph_count;
+    Vector2 size;
+    i32 line_count;
+
+    // NOTE(nick): covers every glyph rect, which can stick out of size
+    Rectangle2 bounds;
+};
+
+//
+// NOTE(nick): image atlas
+//
+// Small images are copied into shared ATLAS_PAGE_SIZE pages when they're loaded instead of each
+// keeping their own allocation, so drawing lots of different sprites touches a few pages of memory
+// rather than pixels scattered all over the heap. Rects are placed bottom-left on a skyline.
+//
+
+#define ATLAS_PAGE_SIZE 1024
+#define ATLAS_MAX_IMAGE_SIZE 256
+
+struct Atlas_Skyline_Node
+{
+    i32 x;
+    i32 y;
+    i32 width;
+};
+
+struct Atlas_Page
+{
+    Atlas_Page *next;
+    u32 *pixels;
+
+    // NOTE(nick): the top edge of everything packed so far, left to right
+    Atlas_Skyline_Node *skyline;
+    i32 skyline_count;
+};
+
+#define IMAGE_ATLAS_MAGIC   0x78696170 // "paix"
+#define IMAGE_ATLAS_VERSION 1
+
+// NOTE(nick): the file is a header, then each image followed by its name, then each page as a
+// u32 byte count and a PNG of premultiplied pixels
+struct Image_Atlas_Header
+{
+    u32 magic;
+    u32 version;
+    u32 page_size;
+    u32 page_count;
+    u32 image_count;
+};
+
+struct Image_Atlas_Entry
+{
+    u32 name_count;
+    // NOTE(nick): U32_MAX for images that were trimmed down to nothing
+    u32 page;
+    Vector2i pos;
+    Vector2i size;
+    b32 trimmed;
+    Rectangle2i trim;
+};
+
+#define TINT_CACHE_SIZE Megabytes(16)
+#define TINT_CACHE_SET_COUNT 64
+#define TINT_CACHE_WAY_COUNT 4
+
+struct Tint_Cache_Entry
+{
+    u32 *source;
+    Vector2i size;
+    u32 tint;
+
+    // NOTE(nick): NULL until the tint has been asked for twice
+    u32 *pixels;
+
+    u64 last_used;
+    u64 frame_used;
+};
+
+struct Draw_Target
+{
+    Image *image;
+
+    // NOTE(nick): out points here while the image is the target
+    Game_Output output;
+
+    Game_Output *prev_out;
+    Draw_State prev_draw;
+    i32 prev_clip_stack_count;
+};
+
+// NOTE(nick): spans rebuilt by EndDrawToImage, owned here since the image and its copies aren't
+struct Draw_Target_Spans
+{
+    u32 *pixels;
+    Image_Spans *spans;
+};
+
 struct Game_State
 {
     Image_Asset images[1024];
@@ -56,24 +423,101 @@ struct Game_State
     Arena *arena;
     String data_path;
 
+    // Drawing
+    // NOTE(nick): the clip rects to go back to, the current one is in g_draw
+    Rectangle2i clip_stack[DRAW_CLIP_STACK_SIZE];
+    i32 clip_stack_count;
+
+    Draw_Target targets[DRAW_TARGET_STACK_SIZE];
+    i32 target_count;
+    Draw_Target_Spans target_spans[DRAW_TARGET_SPANS_COUNT];
+
+    Arena *draw_arena;
+    Draw_Tile *draw_tiles;
+    i32 draw_tile_count_x;
+    i32 draw_tile_count_y;
+    u64 volatile draw_next_tile;
+
+    Work_Queue work_queue;
+    u32 worker_count;
+
+    // NOTE(nick): one byte per DRAW_TILE_SIZE tile that was drawn to this frame
+    u8 *dirty_tiles;
+    i32 dirty_tile_count_x;
+    i32 dirty_tile_count_y;
+    b32 keep_previous_frame;
+
+    u64 frame_index;
+
+    // Palette
+    u32 palette[256];
+    b32 palette_mode;
+    b32 palette_changed;
+
+    // Atlas
+    Atlas_Page *atlas_first;
+    Atlas_Page *atlas_last;
+    u32 atlas_page_count;
+    b32 atlas_trim;
+
+    // Tint Cache
+    Tint_Cache_Entry tint_cache[TINT_CACHE_SET_COUNT * TINT_CACHE_WAY_COUNT];
+    i64 tint_cache_size;
+    u64 tint_cache_tick;
+
+    // Text
+    Arena *text_arena;
+    Text_Layout text_layouts[TEXT_CACHE_SLOT_COUNT];
+    u32 text_layout_count;
+
     // Mixer
-    Playing_Sound_Array playing_sounds;
-    f32 master_volume;
+    Mixer mixer;
+
+    // NOTE(nick): the generation of the last voice started in each slot
+    u32 voice_generations[MIX_VOICE_COUNT];
+
+    Music_Stream music[MUSIC_SLOT_COUNT];
+    // NOTE(nick): posted whenever a music buffer needs decoding
+    Semaphore music_semaphore;
+
+    // NOTE(nick): the Play* calls mix into this on the game thread
+    f32 *mix_bus;
+    i64 mix_bus_capacity;
+
+    // NOTE(nick): each table has a copy of its first sample at the end for the interpolation
+    f32 *wavetables[Waveform_COUNT][WAVETABLE_OCTAVE_COUNT];
 };
 
 static Game_State g_state = {0};
+static thread_local Draw_State g_draw = {0};
 static Game_Input *input = NULL;
 static Game_Output *out  = NULL;
 static Game_Input *prev_input = NULL;
 
+function void WavetablesBuild();
+function void MixerRender(Mixer *mixer, f32 *bus, i64 frame_count, i32 samples_per_second);
+function void MixerOutput(Mixer *mixer, i16 *dest, f32 *bus, i64 frame_count, i32 samples_per_second);
+function THREAD_PROC(MusicDecodeThreadProc);
+
 void GameInit()
 {
     Arena *arena = arena_alloc(Gigabytes(1));
 
+    simd_init();
+
     MemoryZero(&g_state, sizeof(Game_State));
     g_state.rng = {0x6908243098231};
 
     g_state.arena = arena;
+    g_state.draw_arena = arena_alloc(Gigabytes(1));
+    g_state.text_arena = arena_alloc(Gigabytes(1));
+
+    g_state.worker_count = Max(os_processor_count(), 2) - 1;
+    work_queue_init(&g_state.work_queue, g_state.worker_count);
+
+    // NOTE(nick): a max count of 1 so wakeups coalesce, the decode thread looks at every stream anyway
+    g_state.music_semaphore = os_semaphore_create(1);
+    os_thread_detach(os_thread_create(MusicDecodeThreadProc, NULL, 0));
 
     String data_path = os_get_executable_path();
     if (!os_file_exists(path_join(data_path, S("data"))))
@@ -82,18 +526,153 @@ void GameInit()
     }
     g_state.data_path = string_push(arena, data_path);
 
-    g_state.playing_sounds.capacity = 256;
-    g_state.playing_sounds.count = 0;
-    g_state.playing_sounds.data = PushArrayZero(arena, Playing_Sound, g_state.playing_sounds.capacity);
+    Mixer *mixer = &g_state.mixer;
+    mixer->playing_sounds.capacity = 256;
+    mixer->playing_sounds.count = 0;
+    mixer->playing_sounds.data = PushArrayZero(arena, Playing_Sound, mixer->playing_sounds.capacity);
+
+    mixer->master_volume = 1.0;
+    mixer->limiter = true;
+    mixer->limiter_gain = 1.0;
 
-    g_state.master_volume = 1.0;
+    WavetablesBuild();
+
+    // NOTE(nick): 3-3-2 RGB until the game sets its own colors
+    for (u32 i = 0; i < count_of(g_state.palette); i += 1)
+    {
+        u32 r = ((i >> 5) & 7) * 255 / 7;
+        u32 g = ((i >> 2) & 7) * 255 / 7;
+        u32 b = ((i >> 0) & 3) * 255 / 3;
+        g_state.palette[i] = 0xff000000 | (b << 16) | (g << 8) | r;
+    }
 }
 
 void GameSetState(Game_Input *the_input, Game_Output *the_output, Game_Input *the_prev_input)
 {
+    // NOTE(nick): GameEndFrame ends deferred drawing before the frame is presented
+    assert(!g_draw.deferred);
+
     input = the_input;
     out = the_output;
     prev_input = the_prev_input;
+
+    g_draw.clip = r2i(0, 0, out->width, out->height);
+    g_state.clip_stack_count = 0;
+
+    i64 mix_count = (i64)out->sample_count * 2;
+    if (mix_count > g_state.mix_bus_capacity)
+    {
+        if (g_state.mix_bus) os_free(g_state.mix_bus);
+        g_state.mix_bus = (f32 *)os_alloc(mix_count * sizeof(f32));
+        g_state.mix_bus_capacity = mix_count;
+    }
+
+    if (mix_count > 0)
+    {
+        MemoryZero(g_state.mix_bus, mix_count * sizeof(f32));
+    }
+
+    i32 count_x = (out->width  + DRAW_TILE_SIZE - 1) / DRAW_TILE_SIZE;
+    i32 count_y = (out->height + DRAW_TILE_SIZE - 1) / DRAW_TILE_SIZE;
+
+    if (count_x != g_state.dirty_tile_count_x || count_y != g_state.dirty_tile_count_y)
+    {
+        // NOTE(nick): the first frame at a new size has to be presented in full, the window can be
+        // resized every frame so this can't come from the arena
+        if (g_state.dirty_tiles) os_free(g_state.dirty_tiles);
+        g_state.dirty_tiles = (u8 *)os_alloc(count_x * count_y);
+        MemorySet(g_state.dirty_tiles, 1, count_x * count_y);
+        g_state.dirty_tile_count_x = count_x;
+        g_state.dirty_tile_count_y = count_y;
+    }
+}
+
+void GameEndFrame()
+{
+    while (g_state.target_count > 0)
+    {
+        EndDrawToImage();
+    }
+
+    DrawEndDeferred();
+
+    //
+    // NOTE(nick): mix bus output stage
+    //
+
+    i64 frame_count = out->sample_count;
+    if (out->mix_on_audio_thread)
+    {
+        // NOTE(nick): the audio thread mixes this in with everything else and does the limiting
+        out->mix_samples = g_state.mix_bus;
+    }
+    else
+    {
+        MixerRender(&g_state.mixer, g_state.mix_bus, frame_count, out->samples_per_second);
+        MixerOutput(&g_state.mixer, out->samples, g_state.mix_bus, frame_count, out->samples_per_second);
+    }
+
+    out->keep_previous_frame = g_state.keep_previous_frame;
+
+    out->palette_mode = g_state.palette_mode;
+    out->palette_changed = g_state.palette_changed;
+    out->palette = g_state.palette;
+    g_state.palette_changed = false;
+
+    //
+    // NOTE(nick): merge the dirty tiles into rects, every row is split into runs of dirty tiles and a
+    // run that covers exactly the same columns as a rect ending on the row above just extends it
+    //
+
+    i32 count_x = g_state.dirty_tile_count_x;
+    i32 count_y = g_state.dirty_tile_count_y;
+
+    Rectangle2i *rects = PushArray(temp_arena(), Rectangle2i, count_x * count_y);
+    i32 rect_count = 0;
+
+    for (i32 ty = 0; ty < count_y; ty += 1)
+    {
+        u8 *row = &g_state.dirty_tiles[ty * count_x];
+
+        i32 tx = 0;
+        while (tx < count_x)
+        {
+            if (!row[tx]) { tx += 1; continue; }
+
+            i32 run_start = tx;
+            while (tx < count_x && row[tx]) tx += 1;
+
+            Rectangle2i rect = {0};
+            rect.x0 = run_start * DRAW_TILE_SIZE;
+            rect.y0 = ty * DRAW_TILE_SIZE;
+            rect.x1 = Min(tx * DRAW_TILE_SIZE, out->width);
+            rect.y1 = Min((ty + 1) * DRAW_TILE_SIZE, out->height);
+
+            b32 merged = false;
+            for (i32 i = rect_count - 1; i >= 0; i -= 1)
+            {
+                Rectangle2i *it = &rects[i];
+                if (it->y1 == rect.y0 && it->x0 == rect.x0 && it->x1 == rect.x1)
+                {
+                    it->y1 = rect.y1;
+                    merged = true;
+                    break;
+                }
+            }
+
+            if (!merged)
+            {
+                rects[rect_count] = rect;
+                rect_count += 1;
+            }
+        }
+    }
+
+    out->dirty_rects = rects;
+    out->dirty_rect_count = rect_count;
+
+    MemoryZero(g_state.dirty_tiles, count_x * count_y);
+    g_state.frame_index += 1;
 }
 
 //
@@ -156,1044 +735,5371 @@ Asset_Info *GetAssetByIndex(void *array, u64 size, u64 count, i64 index)
     return result;
 }
 
-Image LoadImage(String path)
+// NOTE(nick): all images are stored with premultiplied alpha so blending is just d = s + d * (1 - sa)
+// NOTE(nick): 0 is transparent, 1 is opaque and 2 is partially transparent
+i32 ImageRunKind(u32 pixel)
 {
-    u64 hash = fnv64a(path.data, path.count);
+    if (pixel == 0) return 0;
+    if ((pixel >> 24) == 0xff) return 1;
+    return 2;
+}
 
-    Image_Asset *result = (Image_Asset *)FindAssetByHash(&g_state.images, sizeof(Image_Asset), count_of(g_state.images), hash);
+// NOTE(nick): runs shorter than this aren't worth a call of their own, they get blended along
+// with their neighbours instead
+#define IMAGE_RUN_MIN_LENGTH 16
 
-    if (!result)
+// NOTE(nick): writes the runs of one row to runs (when it isn't NULL) and returns how many there are
+u32 ImageRowRuns(u32 *row, i32 width, Image_Run *runs)
+{
+    u32 count = 0;
+
+    Image_Run pending = {0};
+    b32 has_pending = false;
+
+    i32 x = 0;
+    while (x < width)
     {
-        result = (Image_Asset *)FindFreeAsset(&g_state.images, sizeof(Image_Asset), count_of(g_state.images));
+        i32 kind = ImageRunKind(row[x]);
+        i32 x0 = x;
+        while (x < width && ImageRunKind(row[x]) == kind) x += 1;
 
-        if (!result)
+        b32 is_short = x - x0 < IMAGE_RUN_MIN_LENGTH;
+        b32 can_merge = has_pending && !pending.opaque;
+
+        if (kind == 0)
         {
-            print("[LoadImage] Used all %d slots available! Failed to load image: %.*s\n", count_of(g_state.images), LIT(path));
+            // NOTE(nick): a short gap only gets covered if something after it merges in
+            if (is_short && can_merge) continue;
+
+            if (has_pending && runs) runs[count - 1] = pending;
+            has_pending = false;
+            continue;
         }
-    }
 
-    if (result)
-    {
-        if (result->info.hash == 0)
+        if (kind == 1 && is_short) kind = 2;
+
+        if (kind == 2 && can_merge)
         {
-            M_Temp scratch = GetScratch(0, 0);
+            pending.x1 = x;
+            continue;
+        }
 
-            String contents = os_read_entire_file(scratch.arena, path_join(g_state.data_path, path));
+        if (has_pending && runs) runs[count - 1] = pending;
 
-            if (contents.count > 0)
-            {
-                int width, height, channels;
-                result->image.pixels      = (u32 *)stbi_load_from_memory(contents.data, contents.count, &width, &height, &channels, 4);
-                result->image.size.width  = width;
-                result->image.size.height = height;
-                result->image.index = result->info.index;
-            }
-            else
-            {
-                print("[LoadImage] Image not found: %.*s\n", LIT(path));
-            }
+        pending.x0 = x0;
+        pending.x1 = x;
+        pending.opaque = kind == 1;
+        has_pending = true;
+        count += 1;
+    }
 
-            result->info.name = path;
-            result->info.hash = hash;
+    if (has_pending && runs) runs[count - 1] = pending;
 
-            ReleaseScratch(scratch);
-        }
+    return count;
+}
 
-        return result->image;
+// NOTE(nick): the rect of texels that are actually stored
+Rectangle2i ImageTrim(Image image)
+{
+    if (image.trimmed) return image.trim;
+    return r2i(0, 0, image.size.width, image.size.height);
+}
+
+i32 ImageStride(Image image)
+{
+    if (image.stride) return image.stride;
+    return r2i_width(ImageTrim(image));
+}
+
+Image_Spans *ImageSpansMake(Arena *arena, Image image)
+{
+    Rectangle2i trim = ImageTrim(image);
+    i32 width = r2i_width(trim);
+    i32 height = r2i_height(trim);
+    i32 stride = ImageStride(image);
+    if (!image.pixels || width <= 0 || height <= 0) return NULL;
+
+    u64 run_count = 0;
+    for (i32 y = 0; y < height; y += 1)
+    {
+        run_count += ImageRowRuns(image.pixels + (i64)y * stride, width, NULL);
     }
 
-    return {};
+    if (run_count > U32_MAX) return NULL;
+
+    Image_Spans *result = PushStruct(arena, Image_Spans);
+    result->row_offsets = PushArray(arena, u32, height + 1);
+    result->runs = PushArray(arena, Image_Run, run_count);
+
+    u32 count = 0;
+    for (i32 y = 0; y < height; y += 1)
+    {
+        result->row_offsets[y] = count;
+        count += ImageRowRuns(image.pixels + (i64)y * stride, width, result->runs + count);
+    }
+    result->row_offsets[height] = count;
+
+    return result;
 }
 
-Sound LoadSound(String path)
+// NOTE(nick): same as ImageSpansMake but in a single os_alloc block, for images whose pixels change
+// (free the result with os_free)
+Image_Spans *ImageSpansAlloc(Image image)
 {
-    u64 hash = murmur64(path.data, path.count);
+    M_Temp scratch = GetScratch(0, 0);
 
-    Sound_Asset *result = (Sound_Asset *)FindAssetByHash(&g_state.sounds, sizeof(Sound_Asset), count_of(g_state.sounds), hash);
+    Image_Spans *result = NULL;
 
-    if (!result)
+    Image_Spans *spans = ImageSpansMake(scratch.arena, image);
+    if (spans)
     {
-        result = (Sound_Asset *)FindFreeAsset(&g_state.sounds, sizeof(Sound_Asset), count_of(g_state.sounds));
+        i32 height = r2i_height(ImageTrim(image));
+        u64 runs_size = spans->row_offsets[height] * sizeof(Image_Run);
+        u64 offsets_size = (height + 1) * sizeof(u32);
 
-        if (!result)
+        u8 *data = (u8 *)os_alloc(sizeof(Image_Spans) + runs_size + offsets_size);
+        if (data)
         {
-            print("[LoadSound] Used all %d slots available! Failed to load sound: %.*s\n", count_of(g_state.sounds), LIT(path));
+            result = (Image_Spans *)data;
+            result->runs = (Image_Run *)(data + sizeof(Image_Spans));
+            result->row_offsets = (u32 *)(data + sizeof(Image_Spans) + runs_size);
+
+            MemoryCopy(result->runs, spans->runs, runs_size);
+            MemoryCopy(result->row_offsets, spans->row_offsets, offsets_size);
         }
     }
 
-    if (result)
+    ReleaseScratch(scratch);
+    return result;
+}
+
+void ImagePremultiplyAlpha(Image image)
+{
+    i64 count = (i64)image.size.width * (i64)image.size.height;
+
+    for (i64 index = 0; index < count; index += 1)
     {
-        if (result->info.hash == 0)
-        {
-            M_Temp scratch = GetScratch(0, 0);
+        u32 it = image.pixels[index];
+        u32 a = it >> 24;
+        if (a == 0xff) continue;
 
-            String contents = os_read_entire_file(scratch.arena, path_join(g_state.data_path, path));
+        u32 r = simd__div255(((it >>  0) & 0xff) * a);
+        u32 g = simd__div255(((it >>  8) & 0xff) * a);
+        u32 b = simd__div255(((it >> 16) & 0xff) * a);
 
-            if (contents.count > 0)
-            {
-                unsigned int channels;
-                unsigned int sample_rate;
-                drwav_uint64 total_pcm_frame_count;
-                i16 *samples = drwav_open_memory_and_read_pcm_frames_s16(contents.data, contents.count, &channels, &sample_rate, &total_pcm_frame_count, NULL);
+        image.pixels[index] = (a << 24) | (b << 16) | (g << 8) | r;
+    }
+}
 
-                result->sound.bits_per_sample = 32;
-                result->sound.num_channels = channels;
-                result->sound.sample_rate = sample_rate;
-                result->sound.total_samples = total_pcm_frame_count;
-                result->sound.samples = samples;
-                result->sound.index = result->info.index;
+Atlas_Page *AtlasPageMake()
+{
+    u32 *pixels = (u32 *)os_alloc(ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * sizeof(u32));
+    if (!pixels) return NULL;
 
-                assert(channels == 2);
-                assert(sample_rate == 44100);
-            }
-            else
-            {
-                print("[LoadSound] Sound not found: %.*s\n", LIT(path));
-            }
+    Atlas_Page *page = PushStructZero(g_state.arena, Atlas_Page);
+    page->pixels = pixels;
 
-            result->info.name = path;
-            result->info.hash = hash;
+    // NOTE(nick): every node is at least one pixel wide, plus one while a rect is being inserted
+    page->skyline = PushArray(g_state.arena, Atlas_Skyline_Node, ATLAS_PAGE_SIZE + 1);
+    page->skyline[0] = {0, 0, ATLAS_PAGE_SIZE};
+    page->skyline_count = 1;
 
-            ReleaseScratch(scratch);
-        }
+    QueuePush(g_state.atlas_first, g_state.atlas_last, page);
+    g_state.atlas_page_count += 1;
 
-        return result->sound;
+    return page;
+}
+
+// NOTE(nick): returns where a rect with its left edge on the node at index would rest, -1 if it doesn't fit
+i32 AtlasSkylineFit(Atlas_Page *page, i32 index, i32 width, i32 height)
+{
+    Atlas_Skyline_Node *nodes = page->skyline;
+    if (nodes[index].x + width > ATLAS_PAGE_SIZE) return -1;
+
+    i32 y = 0;
+    i32 remaining = width;
+    while (remaining > 0)
+    {
+        y = Max(y, nodes[index].y);
+        if (y + height > ATLAS_PAGE_SIZE) return -1;
+
+        remaining -= nodes[index].width;
+        index += 1;
     }
 
-    return {};
+    return y;
 }
 
-Font FontMakeFromImageMono(Image image, String alphabet, Vector2i monospaced_letter_size)
+b32 AtlasPagePack(Atlas_Page *page, i32 width, i32 height, Vector2i *result)
 {
-    Font result = {0};
+    Atlas_Skyline_Node *nodes = page->skyline;
 
-    Vector2i cursor = {0, 0};
+    // NOTE(nick): lowest top edge first, then the narrowest node to waste the least space
+    i32 best_index = -1;
+    i32 best_y = 0;
+    i32 best_top = I32_MAX;
+    i32 best_width = I32_MAX;
 
-    String32 unicode_alphabet = string32_from_string(temp_arena(), alphabet);
-    u32 glyph_count = unicode_alphabet.count;
+    for (i32 i = 0; i < page->skyline_count; i += 1)
+    {
+        i32 y = AtlasSkylineFit(page, i, width, height);
+        if (y < 0) continue;
 
-    result.image  = image;
-    result.glyphs = PushArrayZero(g_state.arena, Font_Glyph, glyph_count+1);
-    result.glyph_count = 0;
+        i32 top = y + height;
+        if (top < best_top || (top == best_top && nodes[i].width < best_width))
+        {
+            best_index = i;
+            best_y = y;
+            best_top = top;
+            best_width = nodes[i].width;
+        }
+    }
 
-    Font_Glyph *null_glyph = &result.glyphs[0];
-    null_glyph->character = 0;
-    null_glyph->size = v2i(monospaced_letter_size.x, 0);
-    result.glyph_count += 1;
+    if (best_index < 0) return false;
 
-    for (int index = 0; index < glyph_count; index += 1)
+    *result = v2i(nodes[best_index].x, best_y);
+
+    MemoryMove(nodes + best_index + 1, nodes + best_index, (page->skyline_count - best_index) * sizeof(Atlas_Skyline_Node));
+    nodes[best_index] = {result->x, best_top, width};
+    page->skyline_count += 1;
+
+    // NOTE(nick): cut the new node out of the ones it covers
+    for (i32 i = best_index + 1; i < page->skyline_count;)
     {
-        u32 character = unicode_alphabet.data[index];
+        Atlas_Skyline_Node *prev = &nodes[i - 1];
+        Atlas_Skyline_Node *it = &nodes[i];
 
-        Font_Glyph *glyph = &result.glyphs[result.glyph_count];
-        result.glyph_count += 1;
+        i32 overlap = prev->x + prev->width - it->x;
+        if (overlap <= 0) break;
 
-        glyph->character = character;
-        glyph->pos = cursor;
-        glyph->size = monospaced_letter_size;
-        glyph->line_offset = v2i(0, 0);
-        glyph->xadvance = monospaced_letter_size.x;
+        it->x += overlap;
+        it->width -= overlap;
+        if (it->width > 0) break;
 
-        cursor.x += monospaced_letter_size.x;
-        if (cursor.x >= image.size.width)
+        MemoryMove(nodes + i, nodes + i + 1, (page->skyline_count - i - 1) * sizeof(Atlas_Skyline_Node));
+        page->skyline_count -= 1;
+    }
+
+    for (i32 i = 0; i + 1 < page->skyline_count;)
+    {
+        if (nodes[i].y == nodes[i + 1].y)
         {
-            cursor.x = 0;
-            cursor.y += monospaced_letter_size.y;
+            nodes[i].width += nodes[i + 1].width;
+            MemoryMove(nodes + i + 1, nodes + i + 2, (page->skyline_count - i - 2) * sizeof(Atlas_Skyline_Node));
+            page->skyline_count -= 1;
+        }
+        else
+        {
+            i += 1;
+        }
+    }
+
+    return true;
+}
+
+// NOTE(nick): the smallest rect holding every pixel that isn't fully transparent
+Rectangle2i ImageVisibleBounds(Image image)
+{
+    Rectangle2i result = r2i(image.size.width, image.size.height, 0, 0);
+
+    for (i32 y = 0; y < image.size.height; y += 1)
+    {
+        u32 *row = image.pixels + (i64)y * image.size.width;
+        for (i32 x = 0; x < image.size.width; x += 1)
+        {
+            if (row[x] == 0) continue;
+
+            result.x0 = Min(result.x0, x);
+            result.y0 = Min(result.y0, y);
+            result.x1 = Max(result.x1, x + 1);
+            result.y1 = Max(result.y1, y + 1);
         }
     }
 
+    if (result.x0 >= result.x1) result = r2i(0, 0, 0, 0);
     return result;
 }
 
-Font FontMake(Image image, Font_Glyph *glyphs, u64 glyph_count)
+// NOTE(nick): returns a copy of image that lives in an atlas page, or image itself when it doesn't go in one.
+// Expects tightly packed and untrimmed pixels, which are left for the caller to free.
+Image ImageAtlasAdd(Image image)
 {
-    Font result = {0};
-    result.image = image;
-    result.glyphs = glyphs;
-    result.glyph_count = glyph_count;
+    if (!image.pixels || image.stride || image.trimmed) return image;
+    if (image.size.width > ATLAS_MAX_IMAGE_SIZE || image.size.height > ATLAS_MAX_IMAGE_SIZE) return image;
+
+    Rectangle2i trim = ImageTrim(image);
+    if (g_state.atlas_trim) trim = ImageVisibleBounds(image);
+
+    i32 width = r2i_width(trim);
+    i32 height = r2i_height(trim);
+
+    Image result = image;
+    result.pixels = NULL;
+    result.trimmed = g_state.atlas_trim;
+    result.trim = trim;
+
+    if (width > 0 && height > 0)
+    {
+        Vector2i pos = {0};
+
+        Atlas_Page *page = g_state.atlas_first;
+        while (page && !AtlasPagePack(page, width, height, &pos))
+        {
+            page = page->next;
+        }
+
+        if (!page)
+        {
+            page = AtlasPageMake();
+            if (!page || !AtlasPagePack(page, width, height, &pos)) return image;
+        }
+
+        result.pixels = page->pixels + (i64)pos.y * ATLAS_PAGE_SIZE + pos.x;
+        result.stride = ATLAS_PAGE_SIZE;
+
+        for (i32 y = 0; y < height; y += 1)
+        {
+            u32 *src = image.pixels + (i64)(trim.y0 + y) * image.size.width + trim.x0;
+            MemoryCopy(result.pixels + (i64)y * ATLAS_PAGE_SIZE, src, width * sizeof(u32));
+        }
+    }
+
     return result;
 }
 
-Font LoadFont(String path, String alphabet, Vector2i monospaced_letter_size)
+void ImageAtlasSetTrim(b32 trim)
 {
-    Font result = {0};
+    g_state.atlas_trim = trim;
+}
+
+b32 SaveImageAtlas(String path)
+{
+    M_Temp scratch = GetScratch(0, 0);
+
+    String_List list = {0};
+
+    Image_Atlas_Header *header = PushStructZero(scratch.arena, Image_Atlas_Header);
+    header->magic = IMAGE_ATLAS_MAGIC;
+    header->version = IMAGE_ATLAS_VERSION;
+    header->page_size = ATLAS_PAGE_SIZE;
+    header->page_count = g_state.atlas_page_count;
+    string_list_push(scratch.arena, &list, string_make((u8 *)header, sizeof(Image_Atlas_Header)));
+
+    for (i64 i = 0; i < count_of(g_state.images); i += 1)
+    {
+        Image_Asset *it = &g_state.images[i];
+        if (it->info.hash == 0) continue;
+
+        Image image = it->image;
+
+        Image_Atlas_Entry *entry = PushStructZero(scratch.arena, Image_Atlas_Entry);
+        entry->page = U32_MAX;
+        entry->size = image.size;
+        entry->trimmed = image.trimmed;
+        entry->trim = image.trim;
+
+        u32 page_index = 0;
+        for (Atlas_Page *page = g_state.atlas_first; page; page = page->next)
+        {
+            i64 offset = image.pixels - page->pixels;
+            if (image.pixels && offset >= 0 && offset < ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE)
+            {
+                entry->page = page_index;
+                entry->pos = v2i((i32)(offset % ATLAS_PAGE_SIZE), (i32)(offset / ATLAS_PAGE_SIZE));
+                break;
+            }
+            page_index += 1;
+        }
+
+        // NOTE(nick): images that were too big for a page stay as their own files
+        b32 empty = image.trimmed && (r2i_width(image.trim) <= 0 || r2i_height(image.trim) <= 0);
+        if (entry->page == U32_MAX && !empty) continue;
+
+        entry->name_count = (u32)it->info.name.count;
+        string_list_push(scratch.arena, &list, string_make((u8 *)entry, sizeof(Image_Atlas_Entry)));
+        string_list_push(scratch.arena, &list, it->info.name);
+        header->image_count += 1;
+    }
+
+    b32 success = true;
+
+    for (Atlas_Page *page = g_state.atlas_first; page; page = page->next)
+    {
+        int png_size = 0;
+        u8 *png = stbi_write_png_to_mem((u8 *)page->pixels, ATLAS_PAGE_SIZE * sizeof(u32), ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 4, &png_size);
+        if (!png)
+        {
+            success = false;
+            break;
+        }
+
+        u32 *count = PushStruct(scratch.arena, u32);
+        *count = (u32)png_size;
+        string_list_push(scratch.arena, &list, string_make((u8 *)count, sizeof(u32)));
+        string_list_push(scratch.arena, &list, string_push(scratch.arena, string_make(png, png_size)));
+
+        STBIW_FREE(png);
+    }
+
+    if (success)
+    {
+        String contents = string_list_to_string(scratch.arena, &list);
+        success = os_write_entire_file(path_join(g_state.data_path, path), contents);
+    }
+
+    if (!success)
+    {
+        print("[SaveImageAtlas] Failed to write atlas: %.*s\n", LIT(path));
+    }
 
+    ReleaseScratch(scratch);
+    return success;
+}
+
+b32 ImageAtlasRead(String *at, void *dest, u64 size)
+{
+    if (at->count < size) return false;
+
+    MemoryCopy(dest, at->data, size);
+    at->data += size;
+    at->count -= size;
+    return true;
+}
+
+b32 LoadImageAtlas(String path)
+{
+    M_Temp scratch = GetScratch(0, 0);
+
+    String contents = os_read_entire_file(scratch.arena, path_join(g_state.data_path, path));
+    String at = contents;
+
+    Image_Atlas_Header header = {0};
+    b32 success = ImageAtlasRead(&at, &header, sizeof(header)) &&
+        header.magic == IMAGE_ATLAS_MAGIC &&
+        header.version == IMAGE_ATLAS_VERSION &&
+        header.page_size == ATLAS_PAGE_SIZE;
+
+    if (!success)
+    {
+        print("[LoadImageAtlas] Invalid atlas: %.*s\n", LIT(path));
+        ReleaseScratch(scratch);
+        return false;
+    }
+
+    Image_Atlas_Entry *entries = PushArrayZero(scratch.arena, Image_Atlas_Entry, header.image_count);
+    String *names = PushArrayZero(scratch.arena, String, header.image_count);
+
+    for (u32 i = 0; i < header.image_count && success; i += 1)
+    {
+        success = ImageAtlasRead(&at, &entries[i], sizeof(Image_Atlas_Entry)) && at.count >= entries[i].name_count;
+        if (!success) break;
+
+        names[i] = string_make(at.data, entries[i].name_count);
+        at.data += entries[i].name_count;
+        at.count -= entries[i].name_count;
+    }
+
+    Atlas_Page **pages = PushArrayZero(scratch.arena, Atlas_Page *, header.page_count);
+
+    for (u32 i = 0; i < header.page_count && success; i += 1)
+    {
+        u32 png_size = 0;
+        success = ImageAtlasRead(&at, &png_size, sizeof(u32)) && at.count >= png_size;
+        if (!success) break;
+
+        int width, height, channels;
+        u32 *pixels = (u32 *)stbi_load_from_memory(at.data, png_size, &width, &height, &channels, 4);
+        at.data += png_size;
+        at.count -= png_size;
+
+        success = pixels && width == ATLAS_PAGE_SIZE && height == ATLAS_PAGE_SIZE;
+        if (success)
+        {
+            pages[i] = AtlasPageMake();
+            success = pages[i] != NULL;
+        }
+
+        if (success)
+        {
+            // NOTE(nick): the pixels are already premultiplied, and nothing else gets packed into this page
+            MemoryCopy(pages[i]->pixels, pixels, ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * sizeof(u32));
+            pages[i]->skyline[0] = {0, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE};
+        }
+
+        if (pixels) stbi_image_free(pixels);
+    }
+
+    for (u32 i = 0; i < header.image_count && success; i += 1)
+    {
+        Image_Atlas_Entry *entry = &entries[i];
+        if (entry->page != U32_MAX && entry->page >= header.page_count) continue;
+
+        u64 hash = fnv64a(names[i].data, names[i].count);
+        if (FindAssetByHash(&g_state.images, sizeof(Image_Asset), count_of(g_state.images), hash)) continue;
+
+        Image_Asset *result = (Image_Asset *)FindFreeAsset(&g_state.images, sizeof(Image_Asset), count_of(g_state.images));
+        if (!result)
+        {
+            print("[LoadImageAtlas] Used all %d slots available! Failed to load image: %.*s\n", count_of(g_state.images), LIT(names[i]));
+            break;
+        }
+
+        Image image = {0};
+        image.size = entry->size;
+        image.index = result->info.index;
+        image.trimmed = entry->trimmed;
+        image.trim = entry->trim;
+
+        if (entry->page != U32_MAX)
+        {
+            image.pixels = pages[entry->page]->pixels + (i64)entry->pos.y * ATLAS_PAGE_SIZE + entry->pos.x;
+            image.stride = ATLAS_PAGE_SIZE;
+            image.spans = ImageSpansMake(g_state.arena, image);
+        }
+
+        result->image = image;
+        result->info.name = string_push(g_state.arena, names[i]);
+        result->info.hash = hash;
+    }
+
+    if (!success)
+    {
+        print("[LoadImageAtlas] Invalid atlas: %.*s\n", LIT(path));
+    }
+
+    ReleaseScratch(scratch);
+    return success;
+}
+
+Image LoadImage(String path)
+{
+    u64 hash = fnv64a(path.data, path.count);
+
+    Image_Asset *result = (Image_Asset *)FindAssetByHash(&g_state.images, sizeof(Image_Asset), count_of(g_state.images), hash);
+
+    if (!result)
+    {
+        result = (Image_Asset *)FindFreeAsset(&g_state.images, sizeof(Image_Asset), count_of(g_state.images));
+
+        if (!result)
+        {
+            print("[LoadImage] Used all %d slots available! Failed to load image: %.*s\n", count_of(g_state.images), LIT(path));
+        }
+    }
+
+    if (result)
+    {
+        if (result->info.hash == 0)
+        {
+            M_Temp scratch = GetScratch(0, 0);
+
+            String contents = os_read_entire_file(scratch.arena, path_join(g_state.data_path, path));
+
+            if (contents.count > 0)
+            {
+                int width = 0, height = 0, channels = 0;
+                Image image = {0};
+                image.pixels      = (u32 *)stbi_load_from_memory(contents.data, contents.count, &width, &height, &channels, 4);
+                image.size.width  = width;
+                image.size.height = height;
+                image.index = result->info.index;
+
+                if (image.pixels)
+                {
+                    ImagePremultiplyAlpha(image);
+
+                    result->image = ImageAtlasAdd(image);
+                    if (result->image.pixels != image.pixels) stbi_image_free(image.pixels);
+
+                    result->image.spans = ImageSpansMake(g_state.arena, result->image);
+                }
+                else
+                {
+                    print("[LoadImage] Failed to decode image: %.*s\n", LIT(path));
+                }
+            }
+            else
+            {
+                print("[LoadImage] Image not found: %.*s\n", LIT(path));
+            }
+
+            result->info.name = path;
+            result->info.hash = hash;
+
+            ReleaseScratch(scratch);
+        }
+
+        return result->image;
+    }
+
+    return {};
+}
+
+Sound LoadSound(String path)
+{
     u64 hash = murmur64(path.data, path.count);
-    Font_Asset *asset = (Font_Asset *)FindAssetByHash(&g_state.fonts, sizeof(Font_Asset), count_of(g_state.fonts), hash);
 
-    if (!asset)
+    Sound_Asset *result = (Sound_Asset *)FindAssetByHash(&g_state.sounds, sizeof(Sound_Asset), count_of(g_state.sounds), hash);
+
+    if (!result)
     {
-        asset = (Font_Asset *)FindFreeAsset(&g_state.fonts, sizeof(Font_Asset), count_of(g_state.fonts));
+        result = (Sound_Asset *)FindFreeAsset(&g_state.sounds, sizeof(Sound_Asset), count_of(g_state.sounds));
+
+        if (!result)
+        {
+            print("[LoadSound] Used all %d slots available! Failed to load sound: %.*s\n", count_of(g_state.sounds), LIT(path));
+        }
+    }
+
+    if (result)
+    {
+        if (result->info.hash == 0)
+        {
+            M_Temp scratch = GetScratch(0, 0);
+
+            String contents = os_read_entire_file(scratch.arena, path_join(g_state.data_path, path));
+
+            if (contents.count > 0)
+            {
+                unsigned int channels;
+                unsigned int sample_rate;
+                drwav_uint64 total_pcm_frame_count;
+                i16 *samples = drwav_open_memory_and_read_pcm_frames_s16(contents.data, contents.count, &channels, &sample_rate, &total_pcm_frame_count, NULL);
+
+                result->sound.bits_per_sample = 32;
+                result->sound.num_channels = channels;
+                result->sound.sample_rate = sample_rate;
+                result->sound.total_samples = total_pcm_frame_count;
+                result->sound.samples = samples;
+                result->sound.index = result->info.index;
+
+                assert(channels == 2);
+                assert(sample_rate == 44100);
+            }
+            else
+            {
+                print("[LoadSound] Sound not found: %.*s\n", LIT(path));
+            }
+
+            result->info.name = path;
+            result->info.hash = hash;
+
+            ReleaseScratch(scratch);
+        }
+
+        return result->sound;
+    }
+
+    return {};
+}
+
+u32 FontGlyphHash(u32 character)
+{
+    return character * 0x9E3779B1;
+}
+
+// NOTE(nick): glyphs[0] is the fallback glyph, the first glyph for a character wins
+Font_Glyph_Table *FontGlyphTableMake(Arena *arena, Font_Glyph *glyphs, u32 glyph_count)
+{
+    Font_Glyph_Table *result = PushStructZero(arena, Font_Glyph_Table);
+
+    for (u32 index = 0; index < glyph_count; index += 1)
+    {
+        result->line_height = Max(result->line_height, glyphs[index].size.y);
+    }
+
+    u32 hash_count = 0;
+    for (u32 index = 1; index < glyph_count; index += 1)
+    {
+        u32 character = glyphs[index].character;
+        if (character < count_of(result->latin1))
+        {
+            if (!result->latin1[character]) result->latin1[character] = index;
+        }
+        else
+        {
+            hash_count += 1;
+        }
+    }
+
+    if (hash_count > 0)
+    {
+        u32 capacity = 16;
+        while (capacity < hash_count * 2) capacity *= 2;
+
+        result->mask   = capacity - 1;
+        result->keys   = PushArrayZero(arena, u32, capacity);
+        result->values = PushArrayZero(arena, u32, capacity);
+
+        for (u32 index = 1; index < glyph_count; index += 1)
+        {
+            u32 character = glyphs[index].character;
+            if (character < count_of(result->latin1)) continue;
+
+            u32 slot = FontGlyphHash(character) & result->mask;
+            while (result->values[slot] && result->keys[slot] != character)
+            {
+                slot = (slot + 1) & result->mask;
+            }
+
+            if (!result->values[slot])
+            {
+                result->keys[slot]   = character;
+                result->values[slot] = index;
+            }
+        }
+    }
+
+    return result;
+}
+
+Font FontMakeFromImageMono(Image image, String alphabet, Vector2i monospaced_letter_size)
+{
+    Font result = {0};
+
+    Vector2i cursor = {0, 0};
+
+    String32 unicode_alphabet = string32_from_string(temp_arena(), alphabet);
+    u32 glyph_count = unicode_alphabet.count;
+
+    result.image  = image;
+    result.glyphs = PushArrayZero(g_state.arena, Font_Glyph, glyph_count+1);
+    result.glyph_count = 0;
+
+    Font_Glyph *null_glyph = &result.glyphs[0];
+    null_glyph->character = 0;
+    null_glyph->size = v2i(monospaced_letter_size.x, 0);
+    result.glyph_count += 1;
+
+    for (int index = 0; index < glyph_count; index += 1)
+    {
+        u32 character = unicode_alphabet.data[index];
+
+        Font_Glyph *glyph = &result.glyphs[result.glyph_count];
+        result.glyph_count += 1;
+
+        glyph->character = character;
+        glyph->pos = cursor;
+        glyph->size = monospaced_letter_size;
+        glyph->line_offset = v2i(0, 0);
+        glyph->xadvance = monospaced_letter_size.x;
+
+        cursor.x += monospaced_letter_size.x;
+        if (cursor.x >= image.size.width)
+        {
+            cursor.x = 0;
+            cursor.y += monospaced_letter_size.y;
+        }
+    }
+
+    result.table = FontGlyphTableMake(g_state.arena, result.glyphs, result.glyph_count);
+
+    return result;
+}
+
+Font FontMake(Image image, Font_Glyph *glyphs, u64 glyph_count)
+{
+    Font result = {0};
+    result.image = image;
+    result.glyphs = glyphs;
+    result.glyph_count = glyph_count;
+    result.table = FontGlyphTableMake(g_state.arena, glyphs, glyph_count);
+    return result;
+}
+
+Font LoadFont(String path, String alphabet, Vector2i monospaced_letter_size)
+{
+    Font result = {0};
+
+    u64 hash = murmur64(path.data, path.count);
+    Font_Asset *asset = (Font_Asset *)FindAssetByHash(&g_state.fonts, sizeof(Font_Asset), count_of(g_state.fonts), hash);
+
+    if (!asset)
+    {
+        asset = (Font_Asset *)FindFreeAsset(&g_state.fonts, sizeof(Font_Asset), count_of(g_state.fonts));
+
+        if (!asset)
+        {
+            print("[LoadFont] Used all %d slots available! Failed to load font: %.*s\n", count_of(g_state.fonts), LIT(path));
+        }
+    }
+
+    if (asset)
+    {
+        if (asset->info.hash == 0)
+        {
+            Image image = LoadImage(path);
+            if (image.size.x > 0 && image.size.y > 0)
+            {
+                asset->font = FontMakeFromImageMono(image, alphabet, monospaced_letter_size);
+                asset->info.name = path;
+                asset->info.hash = hash;
+            }
+        }
+
+        result = asset->font;
+    }
+
+    return result;
+}
+
+Font LoadFontExt(String path, Font_Glyph *glyphs, u64 glyph_count)
+{
+    Font result = {0};
+
+    // NOTE(nick): fonts build their glyph table once, so cache them by path and glyph array
+    u64 hash = murmur64_seed(path.data, path.count, (u64)glyphs ^ glyph_count);
+    Font_Asset *asset = (Font_Asset *)FindAssetByHash(&g_state.fonts, sizeof(Font_Asset), count_of(g_state.fonts), hash);
+
+    if (!asset)
+    {
+        asset = (Font_Asset *)FindFreeAsset(&g_state.fonts, sizeof(Font_Asset), count_of(g_state.fonts));
+
+        if (!asset)
+        {
+            print("[LoadFontExt] Used all %d slots available! Failed to load font: %.*s\n", count_of(g_state.fonts), LIT(path));
+        }
+    }
+
+    if (asset)
+    {
+        if (asset->info.hash == 0)
+        {
+            Image image = LoadImage(path);
+            if (image.size.x > 0 && image.size.y > 0)
+            {
+                asset->font = FontMake(image, glyphs, glyph_count);
+                asset->info.name = path;
+                asset->info.hash = hash;
+            }
+        }
+
+        result = asset->font;
+    }
+
+    return result;
+}
+
+//
+// Controller API
+//
+
+b32 ControllerPressed(int index, Controller_Button button)
+{
+    b32 result = false;
+    if (index >= 0 && index < count_of(input->controllers))
+    {
+        if (button >= 0 && button < Button_COUNT)
+        {
+            b32 *prev_state = (b32 *)&prev_input->controllers[index];
+            b32 *state = (b32 *)&input->controllers[index];
+
+            result = !prev_state[button] && state[button];
+        }
+    }
+    return result;
+}
+
+b32 ControllerDown(int index, Controller_Button button)
+{
+    b32 result = false;
+    if (index >= 0 && index < count_of(input->controllers))
+    {
+        if (button >= 0 && button < Button_COUNT)
+        {
+            b32 *prev_state = (b32 *)&prev_input->controllers[index];
+            b32 *state = (b32 *)&input->controllers[index];
+
+            result = state[button];
+        }
+    }
+    return result;
+}
+
+b32 ControllerReleased(int index, Controller_Button button)
+{
+    b32 result = false;
+    if (index >= 0 && index < count_of(input->controllers))
+    {
+        if (button >= 0 && button < Button_COUNT)
+        {
+            b32 *prev_state = (b32 *)&prev_input->controllers[index];
+            b32 *state = (b32 *)&input->controllers[index];
+
+            result = prev_state[button] && !state[button];
+        }
+    }
+    return result;
+}
+
+Vector2 MousePosition()
+{
+    return input->mouse.position;
+}
+
+b32 MousePressed(Mouse_Button button)
+{
+    b32 result = false;
+    if (button >= 0 && button < Mouse_COUNT)
+    {
+        b32 *prev_state = (b32 *)&prev_input->mouse;
+        b32 *state = (b32 *)&input->mouse;
+        result = !prev_state[button] && state[button];
+    }
+    return result;
+}
+
+b32 MouseDown(Mouse_Button button)
+{
+    b32 result = false;
+    if (button >= 0 && button < Mouse_COUNT)
+    {
+        b32 *prev_state = (b32 *)&prev_input->mouse;
+        b32 *state = (b32 *)&input->mouse;
+        result = state[button];
+    }
+    return result;
+}
+
+b32 MouseReleased(Mouse_Button button)
+{
+    b32 result = false;
+    if (button >= 0 && button < Mouse_COUNT)
+    {
+        b32 *prev_state = (b32 *)&prev_input->mouse;
+        b32 *state = (b32 *)&input->mouse;
+        result = prev_state[button] && !state[button];
+    }
+    return result;
+}
+
+//
+// Drawing API
+//
+
+void DrawSetBlendMode(Blend_Mode mode)
+{
+    if (mode < Blend_COUNT)
+    {
+        g_draw.blend_mode = mode;
+    }
+}
+
+Blend_Mode DrawGetBlendMode()
+{
+    return g_draw.blend_mode;
+}
+
+// NOTE(nick): empty results have max == min
+Rectangle2i DrawClipIntersect(Rectangle2i a, Rectangle2i b)
+{
+    Rectangle2i result = {0};
+    result.x0 = Max(a.x0, b.x0);
+    result.y0 = Max(a.y0, b.y0);
+    result.x1 = Max(Min(a.x1, b.x1), result.x0);
+    result.y1 = Max(Min(a.y1, b.y1), result.y0);
+    return result;
+}
+
+void PushClipRect(Rectangle2 rect)
+{
+    assert(g_state.clip_stack_count < DRAW_CLIP_STACK_SIZE);
+    if (g_state.clip_stack_count >= DRAW_CLIP_STACK_SIZE) return;
+
+    g_state.clip_stack[g_state.clip_stack_count] = g_draw.clip;
+    g_state.clip_stack_count += 1;
+
+    // NOTE(nick): same pixels that DrawRect(rect) covers
+    rect = abs_r2(rect);
+    Rectangle2i clip = r2i((i32)rect.x0, (i32)rect.y0, (i32)rect.x1, (i32)rect.y1);
+
+    g_draw.clip = DrawClipIntersect(g_draw.clip, clip);
+}
+
+void PopClipRect()
+{
+    assert(g_state.clip_stack_count > 0);
+    if (g_state.clip_stack_count <= 0) return;
+
+    g_state.clip_stack_count -= 1;
+    g_draw.clip = g_state.clip_stack[g_state.clip_stack_count];
+}
+
+Rectangle2 DrawGetClipRect()
+{
+    Rectangle2i clip = g_draw.clip;
+    return r2_from_f32(clip.x0, clip.y0, clip.x1, clip.y1);
+}
+
+Blend_Op BlendOpFromMode(Blend_Mode mode)
+{
+    switch (mode)
+    {
+        case Blend_None:     return BlendOp_Copy;
+        case Blend_Additive: return BlendOp_Add;
+        case Blend_Multiply: return BlendOp_Multiply;
+    }
+    return BlendOp_Over;
+}
+
+// NOTE(nick): a constant source color can often skip the blend entirely
+Blend_Op BlendOpForColor(Blend_Op op, u32 color)
+{
+    if (op == BlendOp_Over && (color >> 24) == 0xff) op = BlendOp_Copy;
+    return op;
+}
+
+b32 BlendColorIsNoop(Blend_Op op, u32 color)
+{
+    // NOTE(nick): a premultiplied color with zero alpha still adds light
+    if (op == BlendOp_Over || op == BlendOp_Add) return color == 0;
+    return false;
+}
+
+// NOTE(nick): colors are given with straight alpha unless the blend mode says otherwise
+Vector4 BlendPremultiply(Vector4 color)
+{
+    Blend_Mode mode = g_draw.blend_mode;
+    if (mode != Blend_None && mode != Blend_Premultiplied)
+    {
+        color.r *= color.a;
+        color.g *= color.a;
+        color.b *= color.a;
+    }
+    return color;
+}
+
+u32 BlendColorFromV4(Vector4 color)
+{
+    return u32_rgba_from_v4(BlendPremultiply(color));
+}
+
+// NOTE(nick): same as BlendColorFromV4 but rounded, without going through floats
+u32 BlendColorFrom32(Color32 color)
+{
+    Blend_Mode mode = g_draw.blend_mode;
+    if (mode == Blend_None || mode == Blend_Premultiplied) return color;
+
+    u32 a = color >> 24;
+    u32 r = simd__div255(((color >>  0) & 0xff) * a);
+    u32 g = simd__div255(((color >>  8) & 0xff) * a);
+    u32 b = simd__div255(((color >> 16) & 0xff) * a);
+
+    return (a << 24) | (b << 16) | (g << 8) | r;
+}
+
+Gradient_Color GradientColorFromV4(Vector4 color)
+{
+    color = BlendPremultiply(color);
+
+    Gradient_Color result = {0};
+    for (i32 i = 0; i < 4; i += 1)
+    {
+        result.e[i] = (i32)(Clamp(color.e[i], 0, 1) * (255.0f * 65536.0f));
+    }
+    return result;
+}
+
+Gradient_Color GradientColorFrom32(Color32 color)
+{
+    color = BlendColorFrom32(color);
+
+    // NOTE(nick): start in the middle of each step so the result rounds instead of truncating
+    Gradient_Color result = {0};
+    for (i32 i = 0; i < 4; i += 1)
+    {
+        result.e[i] = (i32)((((color >> (8 * i)) & 0xff) << 16) | 0x8000);
+    }
+    return result;
+}
+
+b32 GradientColorIsOpaque(Gradient_Color color)
+{
+    return color.e[3] >= (255 << 16);
+}
+
+Color32 Color32FromRGBA(u8 r, u8 g, u8 b, u8 a)
+{
+    return ((u32)a << 24) | ((u32)b << 16) | ((u32)g << 8) | (u32)r;
+}
+
+Color32 Color32FromVector4(Vector4 color)
+{
+    color.r = Clamp(color.r, 0, 1);
+    color.g = Clamp(color.g, 0, 1);
+    color.b = Clamp(color.b, 0, 1);
+    color.a = Clamp(color.a, 0, 1);
+    return Color32FromRGBA((u8)(color.r * 255.0f + 0.5f), (u8)(color.g * 255.0f + 0.5f), (u8)(color.b * 255.0f + 0.5f), (u8)(color.a * 255.0f + 0.5f));
+}
+
+void DrawSetKeepPreviousFrame(b32 keep)
+{
+    g_state.keep_previous_frame = keep;
+}
+
+void DrawMarkDirty(i32 x0, i32 y0, i32 x1, i32 y1)
+{
+    // NOTE(nick): deferred commands are marked when they are recorded
+    if (g_draw.in_tile) return;
+
+    // NOTE(nick): only the screen has dirty rects
+    if (g_state.target_count > 0) return;
+
+    x0 = Max(x0, 0);
+    y0 = Max(y0, 0);
+    x1 = Min(x1, out->width);
+    y1 = Min(y1, out->height);
+
+    if (x0 >= x1 || y0 >= y1) return;
+
+    i32 count_x = g_state.dirty_tile_count_x;
+
+    for (i32 ty = y0 / DRAW_TILE_SIZE; ty <= (y1 - 1) / DRAW_TILE_SIZE; ty += 1)
+    {
+        for (i32 tx = x0 / DRAW_TILE_SIZE; tx <= (x1 - 1) / DRAW_TILE_SIZE; tx += 1)
+        {
+            g_state.dirty_tiles[ty * count_x + tx] = 1;
+        }
+    }
+}
+
+//
+// Deferred drawing
+//
+
+void DrawResetTiles()
+{
+    Arena *arena = g_state.draw_arena;
+    arena_reset(arena);
+
+    i32 count_x = (out->width  + DRAW_TILE_SIZE - 1) / DRAW_TILE_SIZE;
+    i32 count_y = (out->height + DRAW_TILE_SIZE - 1) / DRAW_TILE_SIZE;
+
+    g_state.draw_tiles = PushArrayZero(arena, Draw_Tile, count_x * count_y);
+    g_state.draw_tile_count_x = count_x;
+    g_state.draw_tile_count_y = count_y;
+
+    for (i32 ty = 0; ty < count_y; ty += 1)
+    {
+        for (i32 tx = 0; tx < count_x; tx += 1)
+        {
+            Draw_Tile *tile = &g_state.draw_tiles[ty * count_x + tx];
+            tile->rect.x0 = tx * DRAW_TILE_SIZE;
+            tile->rect.y0 = ty * DRAW_TILE_SIZE;
+            tile->rect.x1 = Min(tile->rect.x0 + DRAW_TILE_SIZE, out->width);
+            tile->rect.y1 = Min(tile->rect.y0 + DRAW_TILE_SIZE, out->height);
+        }
+    }
+}
+
+// NOTE(nick): bounds are in pixels (max is exclusive) and must cover every pixel the command can touch
+Draw_Command *DrawPushCommand(Draw_Command_Type type, u64 size, Rectangle2i bounds)
+{
+    bounds = DrawClipIntersect(bounds, g_draw.clip);
+    if (bounds.x0 >= bounds.x1 || bounds.y0 >= bounds.y1) return NULL;
+
+    DrawMarkDirty(bounds.x0, bounds.y0, bounds.x1, bounds.y1);
+
+    Arena *arena = g_state.draw_arena;
+
+    Draw_Command *result = (Draw_Command *)arena_push_no_zero(arena, size);
+    result->type = type;
+    result->blend_mode = g_draw.blend_mode;
+    result->clip = g_draw.clip;
+
+    i32 tx0 = bounds.x0 / DRAW_TILE_SIZE;
+    i32 ty0 = bounds.y0 / DRAW_TILE_SIZE;
+    i32 tx1 = (bounds.x1 - 1) / DRAW_TILE_SIZE;
+    i32 ty1 = (bounds.y1 - 1) / DRAW_TILE_SIZE;
+
+    for (i32 ty = ty0; ty <= ty1; ty += 1)
+    {
+        for (i32 tx = tx0; tx <= tx1; tx += 1)
+        {
+            Draw_Tile *tile = &g_state.draw_tiles[ty * g_state.draw_tile_count_x + tx];
+
+            Draw_Bin_Chunk *chunk = tile->last;
+            if (!chunk || chunk->count == DRAW_BIN_CHUNK_SIZE)
+            {
+                chunk = PushStruct(arena, Draw_Bin_Chunk);
+                chunk->next = NULL;
+                chunk->count = 0;
+
+                if (tile->last) tile->last->next = chunk;
+                else tile->first = chunk;
+                tile->last = chunk;
+            }
+
+            chunk->commands[chunk->count] = result;
+            chunk->count += 1;
+        }
+    }
+
+    return result;
+}
+
+#define DrawPushCommandMember(type, member, bounds) \
+    DrawPushCommand(type, OffsetOf(Draw_Command, member) + sizeof(((Draw_Command *)0)->member), bounds)
+
+void PixelDraw(Vector2 pos, u32 color);
+void RectDraw(Rectangle2 rect, u32 color);
+void RectGradientDraw(Rectangle2 rect, Gradient_Color c0, Gradient_Color c1, Gradient_Color c2, Gradient_Color c3);
+void EllipseDraw(Vector2 pos, Vector2 radius, u32 color, f32 thickness, b32 anti_aliased);
+void TriangleDraw(Vector2 p0, Vector2 p1, Vector2 p2, u32 color);
+void TriangleGradientDraw(Vector2 p0, Gradient_Color c0, Vector2 p1, Gradient_Color c1, Vector2 p2, Gradient_Color c2);
+void LineDraw(Vector2 p0, Vector2 p1, u32 color, b32 include_last);
+void ClearDraw(u32 color);
+
+void DrawCommandExecute(Draw_Command *it)
+{
+    g_draw.blend_mode = it->blend_mode;
+
+    switch (it->type)
+    {
+        case DrawCommand_Pixel:       PixelDraw(it->pixel.pos, it->pixel.color); break;
+        case DrawCommand_Rect:        RectDraw(it->rect.rect, it->rect.color); break;
+        case DrawCommand_RectExt:     RectGradientDraw(it->rect_ext.rect, it->rect_ext.c0, it->rect_ext.c1, it->rect_ext.c2, it->rect_ext.c3); break;
+        case DrawCommand_Ellipse:     EllipseDraw(it->ellipse.pos, it->ellipse.radius, it->ellipse.color, it->ellipse.thickness, it->ellipse.anti_aliased); break;
+        case DrawCommand_Triangle:    TriangleDraw(it->triangle.p0, it->triangle.p1, it->triangle.p2, it->triangle.color); break;
+        case DrawCommand_TriangleExt: TriangleGradientDraw(it->triangle_ext.p0, it->triangle_ext.c0, it->triangle_ext.p1, it->triangle_ext.c1, it->triangle_ext.p2, it->triangle_ext.c2); break;
+        case DrawCommand_Line:        LineDraw(it->line.p0, it->line.p1, it->line.color, it->line.include_last); break;
+        case DrawCommand_Image:       DrawImage(it->image.image, it->image.pos); break;
+        case DrawCommand_ImageExt:    DrawImageExt(it->image_ext.image, it->image_ext.rect, it->image_ext.color, it->image_ext.uv); break;
+        case DrawCommand_Clear:       ClearDraw(it->clear.color); break;
+    }
+}
+
+void DrawTileRasterize(Draw_Tile *tile)
+{
+    // NOTE(nick): the main thread also runs tiles while it waits, so it's state has to be restored
+    Draw_State saved = g_draw;
+
+    g_draw.deferred = false;
+    g_draw.in_tile = true;
+
+    for (Draw_Bin_Chunk *chunk = tile->first; chunk != NULL; chunk = chunk->next)
+    {
+        for (i64 i = 0; i < chunk->count; i += 1)
+        {
+            Draw_Command *command = chunk->commands[i];
+            g_draw.clip = DrawClipIntersect(tile->rect, command->clip);
+            DrawCommandExecute(command);
+        }
+    }
+
+    g_draw = saved;
+}
+
+void DrawTilesWorkerProc(void *data)
+{
+    i64 tile_count = g_state.draw_tile_count_x * g_state.draw_tile_count_y;
+
+    for (;;)
+    {
+        u64 index = atomic_add_u64(&g_state.draw_next_tile, 1);
+        if (index >= tile_count) break;
+
+        Draw_Tile *tile = &g_state.draw_tiles[index];
+        if (tile->first) DrawTileRasterize(tile);
+    }
+}
+
+void DrawFlushDeferred()
+{
+    i64 tile_count = g_state.draw_tile_count_x * g_state.draw_tile_count_y;
+
+    i64 busy_count = 0;
+    for (i64 index = 0; index < tile_count; index += 1)
+    {
+        if (g_state.draw_tiles[index].first) busy_count += 1;
+    }
+
+    if (busy_count > 0)
+    {
+        // NOTE(nick): every job keeps pulling tiles until there are none left
+        i64 job_count = Min(busy_count, (i64)g_state.worker_count + 1);
+        job_count = Min(job_count, (i64)count_of(g_state.work_queue.entries) / 2);
+
+        g_state.draw_next_tile = 0;
+
+        for (i64 i = 0; i < job_count; i += 1)
+        {
+            work_queue_add_entry(&g_state.work_queue, DrawTilesWorkerProc, NULL);
+        }
+
+        work_queue_complete_all_work(&g_state.work_queue);
+    }
+
+    DrawResetTiles();
+}
+
+void DrawBeginDeferred()
+{
+    if (g_draw.deferred) return;
+
+    g_draw.deferred = true;
+    DrawResetTiles();
+}
+
+void DrawEndDeferred()
+{
+    if (!g_draw.deferred) return;
+
+    DrawFlushDeferred();
+    g_draw.deferred = false;
+}
+
+void PixelDraw(Vector2 pos, u32 color)
+{
+    i32 x = (i32)pos.x;
+    i32 y = (i32)pos.y;
+
+    if (g_draw.deferred)
+    {
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_Pixel, pixel, r2i(x, y, x + 1, y + 1));
+        if (command)
+        {
+            command->pixel.pos = pos;
+            command->pixel.color = color;
+        }
+        return;
+    }
+
+    Rectangle2i clip = g_draw.clip;
+
+    if (x >= clip.x0 && x < clip.x1 && y >= clip.y0 && y < clip.y1)
+    {
+        DrawMarkDirty(x, y, x + 1, y + 1);
+
+        u32 *at = &out->pixels[y * out->width + x];
+        simd_blend_pixel(BlendOpFromMode(g_draw.blend_mode), at, color);
+    }
+}
+
+void DrawSetPixel(Vector2 pos, Vector4 color)
+{
+    PixelDraw(pos, BlendColorFromV4(color));
+}
+
+void DrawSetPixel32(Vector2 pos, Color32 color)
+{
+    PixelDraw(pos, BlendColorFrom32(color));
+}
+
+u32 DrawGetPixel(Vector2 pos)
+{
+    u32 result = 0;
+
+    if (g_draw.deferred)
+    {
+        DrawFlushDeferred();
+    }
+
+    i32 x = (i32)pos.x;
+    i32 y = (i32)pos.y;
+
+    if (x >= 0 && x < out->width && y >= 0 && y < out->height)
+    {
+        u32 *at = &out->pixels[y * out->width + x];
+        result = *at;
+    }
+
+    return result;
+}
+
+void RectDraw(Rectangle2 rect, u32 color)
+{
+    // TimeFunction;
+
+    rect = abs_r2(rect);
+
+    if (g_draw.deferred)
+    {
+        Rectangle2i bounds = r2i((i32)rect.x0, (i32)rect.y0, (i32)rect.x1, (i32)rect.y1);
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_Rect, rect, bounds);
+        if (command)
+        {
+            command->rect.rect = rect;
+            command->rect.color = color;
+        }
+        return;
+    }
+
+    Rectangle2i clip = g_draw.clip;
+
+    i32 in_x0 = Clamp((i32)rect.x0, clip.x0, clip.x1);
+    i32 in_x1 = Clamp((i32)rect.x1, clip.x0, clip.x1);
+
+    i32 in_y0 = Clamp((i32)rect.y0, clip.y0, clip.y1);
+    i32 in_y1 = Clamp((i32)rect.y1, clip.y0, clip.y1);
+
+    Blend_Op op = BlendOpForColor(BlendOpFromMode(g_draw.blend_mode), color);
+    if (BlendColorIsNoop(op, color)) return;
+
+    i32 width = in_x1 - in_x0;
+    if (width <= 0) return;
+
+    DrawMarkDirty(in_x0, in_y0, in_x1, in_y1);
+
+    u32 *at = &out->pixels[in_y0 * out->width + in_x0];
+
+    for (i32 y = in_y0; y < in_y1; y += 1)
+    {
+        simd_blend_color(op, at, color, width);
+        at += out->width;
+    }
+}
+
+void DrawRect(Rectangle2 rect, Vector4 color)
+{
+    RectDraw(rect, BlendColorFromV4(color));
+}
+
+void DrawRect32(Rectangle2 rect, Color32 color)
+{
+    RectDraw(rect, BlendColorFrom32(color));
+}
+
+/*
+c0 ----- c1
+|        |
+|        |
+|        |
+c2 ----- c3
+*/
+void RectGradientDraw(Rectangle2 rect, Gradient_Color c0, Gradient_Color c1, Gradient_Color c2, Gradient_Color c3)
+{
+    rect = abs_r2(rect);
+
+    // NOTE(nick): the gradient always spans the whole rect, no matter how it's clipped
+    i32 rect_x0 = (i32)rect.x0;
+    i32 rect_y0 = (i32)rect.y0;
+    i32 rect_x1 = (i32)rect.x1;
+    i32 rect_y1 = (i32)rect.y1;
+
+    if (g_draw.deferred)
+    {
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_RectExt, rect_ext, r2i(rect_x0, rect_y0, rect_x1, rect_y1));
+        if (command)
+        {
+            command->rect_ext.rect = rect;
+            command->rect_ext.c0 = c0;
+            command->rect_ext.c1 = c1;
+            command->rect_ext.c2 = c2;
+            command->rect_ext.c3 = c3;
+        }
+        return;
+    }
+
+    Rectangle2i clip = g_draw.clip;
+
+    i32 in_x0 = Clamp(rect_x0, clip.x0, clip.x1);
+    i32 in_x1 = Clamp(rect_x1, clip.x0, clip.x1);
+
+    i32 in_y0 = Clamp(rect_y0, clip.y0, clip.y1);
+    i32 in_y1 = Clamp(rect_y1, clip.y0, clip.y1);
+
+    i32 width = in_x1 - in_x0;
+    if (width <= 0 || in_y0 == in_y1) return;
+
+    DrawMarkDirty(in_x0, in_y0, in_x1, in_y1);
+
+    Blend_Op op = BlendOpFromMode(g_draw.blend_mode);
+    if (op == BlendOp_Over &&
+        GradientColorIsOpaque(c0) && GradientColorIsOpaque(c1) &&
+        GradientColorIsOpaque(c2) && GradientColorIsOpaque(c3))
+    {
+        op = BlendOp_Copy;
+    }
+
+    M_Temp scratch = GetScratch(0, 0);
+    u32 *row_colors = op == BlendOp_Copy ? NULL : PushArray(scratch.arena, u32, width);
+
+    i64 rect_w = rect_x1 - rect_x0;
+    i64 rect_h = rect_y1 - rect_y0;
+
+    u32 *at = &out->pixels[in_y0 * out->width + in_x0];
+
+    for (i32 y = in_y0; y < in_y1; y += 1)
+    {
+        // NOTE(nick): the left and right edges are interpolated down the rect, then each row is a
+        // linear ramp between them
+        i32 start[4];
+        i32 step[4];
+        for (i32 i = 0; i < 4; i += 1)
+        {
+            i64 left  = c0.e[i] + (i64)(c2.e[i] - c0.e[i]) * (y - rect_y0) / rect_h;
+            i64 right = c1.e[i] + (i64)(c3.e[i] - c1.e[i]) * (y - rect_y0) / rect_h;
+
+            // NOTE(nick): start from the truncated step so clipping doesn't change any of the colors
+            step[i]  = (i32)((right - left) / rect_w);
+            start[i] = (i32)(left + (i64)step[i] * (in_x0 - rect_x0));
+        }
+
+        if (op == BlendOp_Copy)
+        {
+            simd_gradient(at, width, start, step);
+        }
+        else
+        {
+            simd_gradient(row_colors, width, start, step);
+            simd_blend(op, at, row_colors, width);
+        }
+
+        at += out->width;
+    }
+
+    ReleaseScratch(scratch);
+}
+
+void DrawRectExt(Rectangle2 rect, Vector4 c0, Vector4 c1, Vector4 c2, Vector4 c3)
+{
+    RectGradientDraw(rect, GradientColorFromV4(c0), GradientColorFromV4(c1), GradientColorFromV4(c2), GradientColorFromV4(c3));
+}
+
+void DrawRectExt32(Rectangle2 rect, Color32 c0, Color32 c1, Color32 c2, Color32 c3)
+{
+    RectGradientDraw(rect, GradientColorFrom32(c0), GradientColorFrom32(c1), GradientColorFrom32(c2), GradientColorFrom32(c3));
+}
+
+void RectOutlineDraw(Rectangle2 rect, u32 color, int thickness)
+{
+    // NOTE(nick): not clamped, the sides that fall outside of the clip rect are clipped away
+    i32 in_x0 = (i32)rect.x0;
+    i32 in_y0 = (i32)rect.y0;
+    i32 in_x1 = (i32)rect.x1;
+    i32 in_y1 = (i32)rect.y1;
+
+    // top
+    RectDraw(r2_from_f32(in_x0, in_y0, in_x1, in_y0+thickness), color);
+
+    // bottom
+    RectDraw(r2_from_f32(in_x0, in_y1, in_x1, in_y1-thickness), color);
+
+    // left
+    RectDraw(r2_from_f32(in_x0, in_y0, in_x0+thickness, in_y1), color);
+
+    // right
+    RectDraw(r2_from_f32(in_x1, in_y0, in_x1-thickness, in_y1), color);
+}
+
+void DrawRectOutline(Rectangle2 rect, Vector4 color, int thickness)
+{
+    RectOutlineDraw(rect, BlendColorFromV4(color), thickness);
+}
+
+void DrawRectOutline32(Rectangle2 rect, Color32 color, int thickness)
+{
+    RectOutlineDraw(rect, BlendColorFrom32(color), thickness);
+}
+
+//
+// NOTE(nick): ellipse rasterizer
+//
+// Pixels are sampled at their centers. Every row is solved for where it crosses the ellipse, so
+// the inside of a row is a single span fill. With anti-aliasing on, the ellipse is solved again
+// half a pixel inside and outside of the edge and only the pixels in between get their coverage
+// computed from an approximate signed distance.
+//
+
+// NOTE(nick): half width of the ellipse at dy from its center, negative when the row misses it
+f32 EllipseHalfWidth(f32 rx, f32 ry, f32 dy)
+{
+    if (rx <= 0 || ry <= 0 || dy <= -ry || dy >= ry) return -1;
+
+    f32 v = dy / ry;
+    return rx * sqrt_f32(1 - v * v);
+}
+
+// NOTE(nick): pixels whose centers are inside of a row span of half width h
+void EllipseSpan(f32 cx, f32 h, i32 clip_x0, i32 clip_x1, i32 *x0, i32 *x1)
+{
+    if (h < 0)
+    {
+        *x0 = clip_x0;
+        *x1 = clip_x0;
+        return;
+    }
+
+    *x0 = Clamp(ceil_i32(cx - h - 0.5f), clip_x0, clip_x1);
+    *x1 = Clamp(ceil_i32(cx + h - 0.5f), clip_x0, clip_x1);
+}
+
+// NOTE(nick): approximate signed distance to the edge using the gradient of the implicit function,
+// positive inside, inv_rx2 and inv_ry2 are 1 / rx^2 and 1 / ry^2
+f32 EllipseDistance(f32 dx, f32 dy, f32 inv_rx2, f32 inv_ry2)
+{
+    f32 nx = dx * inv_rx2;
+    f32 ny = dy * inv_ry2;
+
+    f32 f = dx * nx + dy * ny - 1;
+    f32 g2 = nx * nx + ny * ny;
+
+    if (g2 < 1e-12f) return F32_MAX;
+    return -0.5f * f / sqrt_f32(g2);
+}
+
+u32 EllipseEdgeColor(u32 color, f32 coverage)
+{
+    u32 c = (u32)(coverage * 256);
+
+    u32 rb = (((color & 0x00ff00ff) * c) >> 8) & 0x00ff00ff;
+    u32 ga = (((color >> 8) & 0x00ff00ff) * c) & 0xff00ff00;
+    return rb | ga;
+}
+
+void EllipseDraw(Vector2 pos, Vector2 radius, u32 color, f32 thickness, b32 anti_aliased)
+{
+    f32 rx = radius.x;
+    f32 ry = radius.y;
+    if (rx <= 0 || ry <= 0) return;
+
+    if (g_draw.deferred)
+    {
+        Rectangle2i bounds = {0};
+        bounds.x0 = floor_i32(pos.x - rx - 1);
+        bounds.y0 = floor_i32(pos.y - ry - 1);
+        bounds.x1 = ceil_i32(pos.x + rx + 1);
+        bounds.y1 = ceil_i32(pos.y + ry + 1);
+
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_Ellipse, ellipse, bounds);
+        if (command)
+        {
+            command->ellipse.pos = pos;
+            command->ellipse.radius = radius;
+            command->ellipse.color = color;
+            command->ellipse.thickness = thickness;
+            command->ellipse.anti_aliased = anti_aliased;
+        }
+        return;
+    }
+
+    // NOTE(nick): a thickness of zero (or anything thicker than the ellipse) fills it
+    b32 has_hole = thickness > 0 && thickness < Min(rx, ry);
+    f32 irx = rx - thickness;
+    f32 iry = ry - thickness;
+
+    f32 edge = anti_aliased ? 0.5f : 0;
+
+    u32 out_color = color;
+
+    Blend_Op op = BlendOpFromMode(g_draw.blend_mode);
+    Blend_Op fill_op = BlendOpForColor(op, out_color);
+    if (BlendColorIsNoop(fill_op, out_color)) return;
+
+    // NOTE(nick): partially covered pixels always need to be blended
+    Blend_Op edge_op = op == BlendOp_Copy ? BlendOp_Over : op;
+
+    f32 inv_rx2 = 1 / (rx * rx);
+    f32 inv_ry2 = 1 / (ry * ry);
+    f32 inv_irx2 = has_hole ? 1 / (irx * irx) : 0;
+    f32 inv_iry2 = has_hole ? 1 / (iry * iry) : 0;
+
+    Rectangle2i clip = g_draw.clip;
+
+    i32 in_y0 = Clamp(floor_i32(pos.y - ry - edge), clip.y0, clip.y1);
+    i32 in_y1 = Clamp(ceil_i32(pos.y + ry + edge), clip.y0, clip.y1);
+
+    i32 in_x0 = Clamp(floor_i32(pos.x - rx - edge), clip.x0, clip.x1);
+    i32 in_x1 = Clamp(ceil_i32(pos.x + rx + edge), clip.x0, clip.x1);
+    DrawMarkDirty(in_x0, in_y0, in_x1, in_y1);
+
+    for (i32 y = in_y0; y < in_y1; y += 1)
+    {
+        f32 dy = y + 0.5f - pos.y;
+
+        // NOTE(nick): touched pixels, fully covered pixels, pixels touched by the hole and pixels fully inside the hole
+        i32 touch_x0, touch_x1, full_x0, full_x1, hole_x0, hole_x1, empty_x0, empty_x1;
+        EllipseSpan(pos.x, EllipseHalfWidth(rx + edge, ry + edge, dy), clip.x0, clip.x1, &touch_x0, &touch_x1);
+        if (touch_x0 >= touch_x1) continue;
+
+        EllipseSpan(pos.x, EllipseHalfWidth(rx - edge, ry - edge, dy), clip.x0, clip.x1, &full_x0, &full_x1);
+
+        f32 hole_h = has_hole ? EllipseHalfWidth(irx + edge, iry + edge, dy) : -1;
+        f32 empty_h = has_hole ? EllipseHalfWidth(irx - edge, iry - edge, dy) : -1;
+        EllipseSpan(pos.x, hole_h, clip.x0, clip.x1, &hole_x0, &hole_x1);
+        EllipseSpan(pos.x, empty_h, clip.x0, clip.x1, &empty_x0, &empty_x1);
+
+        u32 *row = &out->pixels[y * out->width];
+
+        i32 x = touch_x0;
+        while (x < touch_x1)
+        {
+            if (x >= empty_x0 && x < empty_x1)
+            {
+                x = empty_x1;
+                continue;
+            }
+
+            // NOTE(nick): fully covered runs end where the hole starts to touch them
+            if (x >= full_x0 && x < full_x1 && !(x >= hole_x0 && x < hole_x1))
+            {
+                i32 run_end = full_x1;
+                if (x < hole_x0) run_end = Min(run_end, hole_x0);
+
+                simd_blend_color(fill_op, row + x, out_color, run_end - x);
+                x = run_end;
+                continue;
+            }
+
+            f32 dx = x + 0.5f - pos.x;
+
+            f32 coverage = 1;
+            if (anti_aliased)
+            {
+                coverage = Clamp(EllipseDistance(dx, dy, inv_rx2, inv_ry2) + 0.5f, 0.0f, 1.0f);
+                if (has_hole)
+                {
+                    f32 hole_coverage = Clamp(EllipseDistance(dx, dy, inv_irx2, inv_iry2) + 0.5f, 0.0f, 1.0f);
+                    coverage = Max(coverage - hole_coverage, 0.0f);
+                }
+            }
+
+            if (coverage > 0)
+            {
+                u32 pixel_color = EllipseEdgeColor(out_color, coverage);
+                simd_blend_pixel(edge_op, row + x, pixel_color);
+            }
+
+            x += 1;
+        }
+    }
+}
+
+void DrawEllipseExt(Vector2 pos, Vector2 radius, Vector4 color, f32 thickness, b32 anti_aliased)
+{
+    EllipseDraw(pos, radius, BlendColorFromV4(color), thickness, anti_aliased);
+}
+
+void DrawEllipseExt32(Vector2 pos, Vector2 radius, Color32 color, f32 thickness, b32 anti_aliased)
+{
+    EllipseDraw(pos, radius, BlendColorFrom32(color), thickness, anti_aliased);
+}
+
+void DrawEllipse(Vector2 pos, Vector2 radius, Vector4 color)
+{
+    DrawEllipseExt(pos, radius, color, 0, false);
+}
+
+void DrawEllipse32(Vector2 pos, Vector2 radius, Color32 color)
+{
+    DrawEllipseExt32(pos, radius, color, 0, false);
+}
+
+void DrawEllipseOutline(Vector2 pos, Vector2 radius, Vector4 color, f32 thickness)
+{
+    DrawEllipseExt(pos, radius, color, Max(thickness, 1), false);
+}
+
+void DrawEllipseOutline32(Vector2 pos, Vector2 radius, Color32 color, f32 thickness)
+{
+    DrawEllipseExt32(pos, radius, color, Max(thickness, 1), false);
+}
+
+void DrawCircle(Vector2 pos, f32 radius, Vector4 color)
+{
+    DrawEllipseExt(pos, v2(radius, radius), color, 0, false);
+}
+
+void DrawCircle32(Vector2 pos, f32 radius, Color32 color)
+{
+    DrawEllipseExt32(pos, v2(radius, radius), color, 0, false);
+}
+
+void DrawCircleOutline(Vector2 pos, f32 radius, Vector4 color, f32 thickness)
+{
+    DrawEllipseExt(pos, v2(radius, radius), color, Max(thickness, 1), false);
+}
+
+void DrawCircleOutline32(Vector2 pos, f32 radius, Color32 color, f32 thickness)
+{
+    DrawEllipseExt32(pos, v2(radius, radius), color, Max(thickness, 1), false);
+}
+
+//
+// NOTE(nick): half-space triangle rasterizer
+//
+// Every edge gets an edge function e(x, y) = a * (x - x0) + b * (y - y0) that is >= 0 on the inside
+// of the triangle. The bounding box is walked in 8x8 blocks: blocks that are entirely outside one edge
+// are skipped, blocks that are entirely inside all three edges are filled without any tests and only
+// the blocks along the edges are tested, LANE_WIDTH pixels at a time.
+//
+
+#define TRIANGLE_BLOCK_SIZE 8
+
+struct Triangle_Edge
+{
+    f32 a, b;
+    f32 x0, y0;
+};
+
+struct Triangle_Setup
+{
+    Triangle_Edge edges[3];
+    f32 area;
+
+    // NOTE(nick): clipped bounding box, max is exclusive
+    i32 x0, y0;
+    i32 x1, y1;
+};
+
+struct Triangle_Shade
+{
+    Blend_Op op;
+    b32 is_gradient;
+    u32 color;
+
+    // NOTE(nick): channel(x, y) = base + dx * x + dy * y, in 16.16 fixed point
+    i64 base[4];
+    i64 dx[4];
+    i64 dy[4];
+};
+
+Triangle_Edge TriangleEdgeMake(Vector2 from, Vector2 to)
+{
+    Triangle_Edge result = {0};
+    result.a  = from.y - to.y;
+    result.b  = to.x - from.x;
+    result.x0 = from.x;
+    result.y0 = from.y;
+    return result;
+}
+
+b32 TriangleSetup(Triangle_Setup *setup, Vector2 p0, Vector2 p1, Vector2 p2)
+{
+    // NOTE(nick): edges[i] is the edge opposite to vertex i, so it's also the barycentric weight of that vertex
+    setup->edges[0] = TriangleEdgeMake(p1, p2);
+    setup->edges[1] = TriangleEdgeMake(p2, p0);
+    setup->edges[2] = TriangleEdgeMake(p0, p1);
+
+    f32 area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+    if (!(area != 0)) return false;
+
+    // NOTE(nick): accept either winding
+    if (area < 0)
+    {
+        for (i32 i = 0; i < 3; i += 1)
+        {
+            setup->edges[i].a = -setup->edges[i].a;
+            setup->edges[i].b = -setup->edges[i].b;
+        }
+        area = -area;
+    }
+    setup->area = area;
+
+    f32 min_x = min_f32(p0.x, min_f32(p1.x, p2.x));
+    f32 max_x = max_f32(p0.x, max_f32(p1.x, p2.x));
+
+    f32 min_y = min_f32(p0.y, min_f32(p1.y, p2.y));
+    f32 max_y = max_f32(p0.y, max_f32(p1.y, p2.y));
+
+    Rectangle2i clip = g_draw.clip;
+
+    setup->x0 = Clamp((i32)min_x, clip.x0, clip.x1);
+    setup->x1 = Clamp((i32)max_x, clip.x0, clip.x1);
+
+    setup->y0 = Clamp((i32)min_y, clip.y0, clip.y1);
+    setup->y1 = Clamp((i32)max_y, clip.y0, clip.y1);
+
+    return setup->x0 < setup->x1 && setup->y0 < setup->y1;
+}
+
+// NOTE(nick): colors of count pixels starting at (x, y)
+void TriangleShadeRow(Triangle_Shade *shade, i32 x, i32 y, i32 count, u32 *colors)
+{
+    // NOTE(nick): clamping keeps a short row from overflowing, the channels it clamps are far
+    // outside of 0..255 either way
+    i32 start[4];
+    i32 step[4];
+    for (i32 i = 0; i < 4; i += 1)
+    {
+        i64 c = shade->base[i] + shade->dx[i] * x + shade->dy[i] * y;
+        start[i] = (i32)Clamp(c, -((i64)1 << 30), (i64)1 << 30);
+        step[i]  = (i32)Clamp(shade->dx[i], -((i64)1 << 26), (i64)1 << 26);
+    }
+
+    simd_gradient(colors, count, start, step);
+}
+
+void TriangleWriteLanes(u32 *at, i32 count, Blend_Op op, Lane_U32 color, Lane_U32 mask, u32 mask_bits)
+{
+    u32 full_mask = (1 << LANE_WIDTH) - 1;
+
+    if (op != BlendOp_Copy)
+    {
+        u32 values[LANE_WIDTH];
+        lane_u32_store(values, color);
+
+        // NOTE(nick): blend each run of covered pixels
+        i32 i = 0;
+        while (i < count)
+        {
+            if (!(mask_bits & (1 << i))) { i += 1; continue; }
+
+            i32 run_start = i;
+            while (i < count && (mask_bits & (1 << i))) i += 1;
+
+            simd_blend(op, at + run_start, values + run_start, i - run_start);
+        }
+    }
+    else if (count == LANE_WIDTH)
+    {
+        if (mask_bits != full_mask)
+        {
+            color = lane_u32_select(mask, color, lane_u32_load(at));
+        }
+        lane_u32_store(at, color);
+    }
+    else
+    {
+        u32 values[LANE_WIDTH];
+        lane_u32_store(values, color);
+
+        for (i32 i = 0; i < count; i += 1)
+        {
+            if (mask_bits & (1 << i)) at[i] = values[i];
+        }
+    }
+}
+
+void TriangleRasterize(Triangle_Setup *setup, Triangle_Shade *shade)
+{
+    DrawMarkDirty(setup->x0, setup->y0, setup->x1, setup->y1);
+
+    Lane_F32 zero = lane_f32_set1(0);
+    Lane_F32 offsets = lane_f32(0, 1, 2, 3);
+
+    Lane_F32 edge_lane_offsets[3];
+    Lane_F32 edge_lane_steps[3];
+    for (i32 i = 0; i < 3; i += 1)
+    {
+        edge_lane_offsets[i] = lane_f32_set1(setup->edges[i].a) * offsets;
+        edge_lane_steps[i]   = lane_f32_set1(setup->edges[i].a * LANE_WIDTH);
+    }
+
+    // NOTE(nick): blocks are aligned to the screen, not to the clip rect, so that the same pixels get
+    // evaluated the same way no matter how the triangle is split up by clipping
+    i32 block_align = ~(TRIANGLE_BLOCK_SIZE - 1);
+
+    for (i32 block_y = setup->y0 & block_align; block_y < setup->y1; block_y += TRIANGLE_BLOCK_SIZE)
+    {
+        i32 by = Max(block_y, setup->y0);
+        i32 block_h = Min(block_y + TRIANGLE_BLOCK_SIZE, setup->y1) - by;
+
+        for (i32 block_x = setup->x0 & block_align; block_x < setup->x1; block_x += TRIANGLE_BLOCK_SIZE)
+        {
+            i32 bx = Max(block_x, setup->x0);
+            i32 block_w = Min(block_x + TRIANGLE_BLOCK_SIZE, setup->x1) - bx;
+
+            // NOTE(nick): edge functions are linear, so checking the block corners is enough
+            f32 edge_row[3];
+            b32 is_empty = false;
+            b32 is_full  = true;
+
+            for (i32 i = 0; i < 3; i += 1)
+            {
+                Triangle_Edge *edge = &setup->edges[i];
+
+                f32 e  = edge->a * (bx - edge->x0) + edge->b * (by - edge->y0);
+                f32 ex = edge->a * (block_w - 1);
+                f32 ey = edge->b * (block_h - 1);
+
+                f32 e_min = e + Min(ex, 0) + Min(ey, 0);
+                f32 e_max = e + Max(ex, 0) + Max(ey, 0);
+
+                if (e_max < 0) { is_empty = true; break; }
+                if (e_min < 0) { is_full = false; }
+
+                edge_row[i] = e;
+            }
+
+            if (is_empty) continue;
+
+            u32 *row = &out->pixels[by * out->width + bx];
+
+            // NOTE(nick): a whole number of lanes, the ones past block_w are never written out
+            u32 row_colors[TRIANGLE_BLOCK_SIZE] = {0};
+
+            for (i32 y = 0; y < block_h; y += 1)
+            {
+                if (shade->is_gradient)
+                {
+                    TriangleShadeRow(shade, bx, by + y, block_w, row_colors);
+                }
+
+                Lane_F32 edge_lanes[3];
+                for (i32 i = 0; i < 3; i += 1)
+                {
+                    edge_lanes[i] = lane_f32_set1(edge_row[i]) + edge_lane_offsets[i];
+                    edge_row[i] += setup->edges[i].b;
+                }
+
+                for (i32 x = 0; x < block_w; x += LANE_WIDTH)
+                {
+                    i32 count = Min(LANE_WIDTH, block_w - x);
+
+                    Lane_U32 mask = lane_u32_set1(U32_MAX);
+                    u32 mask_bits = (1 << LANE_WIDTH) - 1;
+
+                    if (!is_full)
+                    {
+                        for (i32 i = 0; i < 3; i += 1)
+                        {
+                            mask = mask & lane_f32_ge(edge_lanes[i], zero);
+                            edge_lanes[i] += edge_lane_steps[i];
+                        }
+
+                        mask_bits = lane_u32_mask_bits(mask);
+                        if (!mask_bits) continue;
+                    }
+
+                    Lane_U32 color = shade->is_gradient ? lane_u32_load(row_colors + x) : lane_u32_set1(shade->color);
+
+                    TriangleWriteLanes(row + x, count, shade->op, color, mask, mask_bits);
+                }
+
+                row += out->width;
+            }
+        }
+    }
+}
+
+Rectangle2i TriangleBounds(Vector2 p0, Vector2 p1, Vector2 p2)
+{
+    Rectangle2i result = {0};
+    result.x0 = (i32)min_f32(p0.x, min_f32(p1.x, p2.x));
+    result.y0 = (i32)min_f32(p0.y, min_f32(p1.y, p2.y));
+    result.x1 = (i32)max_f32(p0.x, max_f32(p1.x, p2.x));
+    result.y1 = (i32)max_f32(p0.y, max_f32(p1.y, p2.y));
+    return result;
+}
+
+void TriangleDraw(Vector2 p0, Vector2 p1, Vector2 p2, u32 color)
+{
+    if (g_draw.deferred)
+    {
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_Triangle, triangle, TriangleBounds(p0, p1, p2));
+        if (command)
+        {
+            command->triangle.p0 = p0;
+            command->triangle.p1 = p1;
+            command->triangle.p2 = p2;
+            command->triangle.color = color;
+        }
+        return;
+    }
+
+    Triangle_Setup setup;
+    if (!TriangleSetup(&setup, p0, p1, p2)) return;
+
+    Triangle_Shade shade = {0};
+    shade.color = color;
+    shade.op = BlendOpForColor(BlendOpFromMode(g_draw.blend_mode), shade.color);
+    if (BlendColorIsNoop(shade.op, shade.color)) return;
+
+    TriangleRasterize(&setup, &shade);
+}
+
+void DrawTriangle(Vector2 p0, Vector2 p1, Vector2 p2, Vector4 color)
+{
+    TriangleDraw(p0, p1, p2, BlendColorFromV4(color));
+}
+
+void DrawTriangle32(Vector2 p0, Vector2 p1, Vector2 p2, Color32 color)
+{
+    TriangleDraw(p0, p1, p2, BlendColorFrom32(color));
+}
+
+void TriangleGradientDraw(Vector2 p0, Gradient_Color c0, Vector2 p1, Gradient_Color c1, Vector2 p2, Gradient_Color c2)
+{
+    if (g_draw.deferred)
+    {
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_TriangleExt, triangle_ext, TriangleBounds(p0, p1, p2));
+        if (command)
+        {
+            command->triangle_ext.p0 = p0;
+            command->triangle_ext.p1 = p1;
+            command->triangle_ext.p2 = p2;
+            command->triangle_ext.c0 = c0;
+            command->triangle_ext.c1 = c1;
+            command->triangle_ext.c2 = c2;
+        }
+        return;
+    }
+
+    Triangle_Setup setup;
+    if (!TriangleSetup(&setup, p0, p1, p2)) return;
+
+    Blend_Op op = BlendOpFromMode(g_draw.blend_mode);
+    if (op == BlendOp_Over && GradientColorIsOpaque(c0) && GradientColorIsOpaque(c1) && GradientColorIsOpaque(c2))
+    {
+        op = BlendOp_Copy;
+    }
+
+    Triangle_Edge *e1 = &setup.edges[1];
+    Triangle_Edge *e2 = &setup.edges[2];
+
+    Triangle_Shade shade = {0};
+    shade.op = op;
+    shade.is_gradient = true;
+
+    // NOTE(nick): color = c0 + (c1 - c0) * w1 + (c2 - c0) * w2, where w1 and w2 are the barycentric weights
+    // of p1 and p2, both of which are 0 at p0. The plane is set up in doubles once and then only
+    // stepped in fixed point.
+    f64 inv_area = 1.0 / setup.area;
+    for (i32 i = 0; i < 4; i += 1)
+    {
+        f64 d1 = (f64)(c1.e[i] - c0.e[i]);
+        f64 d2 = (f64)(c2.e[i] - c0.e[i]);
+
+        f64 dx = (d1 * e1->a + d2 * e2->a) * inv_area;
+        f64 dy = (d1 * e1->b + d2 * e2->b) * inv_area;
+
+        shade.dx[i]   = round_i64(dx);
+        shade.dy[i]   = round_i64(dy);
+        shade.base[i] = round_i64(c0.e[i] - dx * p0.x - dy * p0.y);
+    }
+
+    TriangleRasterize(&setup, &shade);
+}
+
+void DrawTriangleExt(Vector2 p0, Vector4 c0, Vector2 p1, Vector4 c1, Vector2 p2, Vector4 c2)
+{
+    TriangleGradientDraw(p0, GradientColorFromV4(c0), p1, GradientColorFromV4(c1), p2, GradientColorFromV4(c2));
+}
+
+void DrawTriangleExt32(Vector2 p0, Color32 c0, Vector2 p1, Color32 c1, Vector2 p2, Color32 c2)
+{
+    TriangleGradientDraw(p0, GradientColorFrom32(c0), p1, GradientColorFrom32(c1), p2, GradientColorFrom32(c2));
+}
+
+//
+// NOTE(nick): Lines
+//
+
+struct Line_Batch
+{
+    Rectangle2i clip;
+    Blend_Op op;
+    u32 color;
+};
+
+// NOTE(nick): returns false when the lines wouldn't change any pixels
+b32 LineBatchMake(Line_Batch *batch, u32 color)
+{
+    batch->clip = g_draw.clip;
+    batch->color = color;
+    batch->op = BlendOpForColor(BlendOpFromMode(g_draw.blend_mode), batch->color);
+    return !BlendColorIsNoop(batch->op, batch->color);
+}
+
+i64 FloorDivI64(i64 a, i64 b)
+{
+    assert(b > 0);
+    i64 result = a / b;
+    if ((a % b) != 0 && a < 0) result -= 1;
+    return result;
+}
+
+i64 CeilDivI64(i64 a, i64 b)
+{
+    return -FloorDivI64(-a, b);
+}
+
+// NOTE(nick): the k-th pixel along the major axis is offset round(k * minor / major) on the minor axis.
+// Because each pixel only depends on the endpoints, the line can be clipped by jumping straight to the
+// first visible step and it will touch exactly the same pixels through every clip rect.
+void LineRasterize(Line_Batch *batch, i32 x0, i32 y0, i32 x1, i32 y1, b32 include_last)
+{
+    Rectangle2i clip = batch->clip;
+
+    i64 dx = x1 >= x0 ? (i64)x1 - x0 : (i64)x0 - x1;
+    i64 dy = y1 >= y0 ? (i64)y1 - y0 : (i64)y0 - y1;
+    i32 sx = x1 >= x0 ? 1 : -1;
+    i32 sy = y1 >= y0 ? 1 : -1;
+
+    b32 x_major = dx >= dy;
+    i64 major = x_major ? dx : dy;
+    i64 minor = x_major ? dy : dx;
+
+    if (major == 0)
+    {
+        if (include_last && x0 >= clip.x0 && x0 < clip.x1 && y0 >= clip.y0 && y0 < clip.y1)
+        {
+            DrawMarkDirty(x0, y0, x0 + 1, y0 + 1);
+            simd_blend_pixel(batch->op, &out->pixels[y0 * out->width + x0], batch->color);
+        }
+        return;
+    }
+
+    i64 major_start = x_major ? x0 : y0;
+    i64 minor_start = x_major ? y0 : x0;
+    i32 major_sign  = x_major ? sx : sy;
+    i32 minor_sign  = x_major ? sy : sx;
+
+    i64 major_lo = x_major ? clip.x0 : clip.y0;
+    i64 major_hi = x_major ? clip.x1 : clip.y1;
+    i64 minor_lo = x_major ? clip.y0 : clip.x0;
+    i64 minor_hi = x_major ? clip.y1 : clip.x1;
+
+    // NOTE(nick): visible steps are [k0, k1)
+    i64 k0 = 0;
+    i64 k1 = include_last ? major + 1 : major;
+
+    if (major_sign > 0)
+    {
+        k0 = Max(k0, major_lo - major_start);
+        k1 = Min(k1, major_hi - major_start);
+    }
+    else
+    {
+        k0 = Max(k0, major_start - major_hi + 1);
+        k1 = Min(k1, major_start - major_lo + 1);
+    }
+
+    // NOTE(nick): visible minor offsets are [q0, q1]
+    i64 q0 = minor_sign > 0 ? minor_lo - minor_start : minor_start - minor_hi + 1;
+    i64 q1 = minor_sign > 0 ? minor_hi - 1 - minor_start : minor_start - minor_lo;
+
+    if (minor == 0)
+    {
+        if (q0 > 0 || q1 < 0) return;
+    }
+    else
+    {
+        // NOTE(nick): offset(k) = floor((2 * k * minor + major) / (2 * major))
+        k0 = Max(k0, CeilDivI64(2 * major * q0 - major, 2 * minor));
+        k1 = Min(k1, FloorDivI64(2 * major * (q1 + 1) - major - 1, 2 * minor) + 1);
+    }
+
+    if (k0 >= k1) return;
+
+    i64 count = k1 - k0;
+    i64 den = 2 * major;
+    i64 num = 2 * k0 * minor + major;
+    i64 q = num / den;
+    i64 rem = num - q * den;
+
+    i32 x, y, x_last, y_last;
+    {
+        i64 major_at   = major_start + major_sign * k0;
+        i64 minor_at   = minor_start + minor_sign * q;
+        i64 major_end  = major_start + major_sign * (k1 - 1);
+        i64 minor_end  = minor_start + minor_sign * ((2 * (k1 - 1) * minor + major) / den);
+
+        x      = (i32)(x_major ? major_at : minor_at);
+        y      = (i32)(x_major ? minor_at : major_at);
+        x_last = (i32)(x_major ? major_end : minor_end);
+        y_last = (i32)(x_major ? minor_end : major_end);
+    }
+
+    DrawMarkDirty(Min(x, x_last), Min(y, y_last), Max(x, x_last) + 1, Max(y, y_last) + 1);
+
+    i64 stride = out->width;
+    u32 *at = &out->pixels[y * stride + x];
+    u32 color = batch->color;
+    Blend_Op op = batch->op;
+
+    // NOTE(nick): horizontal lines are a single span
+    if (minor == 0 && x_major)
+    {
+        simd_blend_color(op, &out->pixels[y * stride + Min(x, x_last)], color, count);
+        return;
+    }
+
+    i64 major_step = x_major ? major_sign : major_sign * stride;
+    i64 minor_step = x_major ? minor_sign * stride : minor_sign;
+
+    if (minor == 0)
+    {
+        if (op == BlendOp_Copy)
+        {
+            for (i64 i = 0; i < count; i += 1)
+            {
+                *at = color;
+                at += major_step;
+            }
+        }
+        else
+        {
+            for (i64 i = 0; i < count; i += 1)
+            {
+                simd_blend_pixel(op, at, color);
+                at += major_step;
+            }
+        }
+        return;
+    }
+
+    i64 rem_step = 2 * minor;
+
+    if (op == BlendOp_Copy)
+    {
+        for (i64 i = 0; i < count; i += 1)
+        {
+            *at = color;
+            at += major_step;
+            rem += rem_step;
+            if (rem >= den) { rem -= den; at += minor_step; }
+        }
+    }
+    else
+    {
+        for (i64 i = 0; i < count; i += 1)
+        {
+            simd_blend_pixel(op, at, color);
+            at += major_step;
+            rem += rem_step;
+            if (rem >= den) { rem -= den; at += minor_step; }
+        }
+    }
+}
+
+void LineDraw(Vector2 p0, Vector2 p1, u32 color, b32 include_last)
+{
+    i32 x0 = (i32)p0.x;
+    i32 y0 = (i32)p0.y;
+    i32 x1 = (i32)p1.x;
+    i32 y1 = (i32)p1.y;
+
+    if (g_draw.deferred)
+    {
+        Rectangle2i bounds = r2i(Min(x0, x1), Min(y0, y1), Max(x0, x1) + 1, Max(y0, y1) + 1);
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_Line, line, bounds);
+        if (command)
+        {
+            command->line.p0 = p0;
+            command->line.p1 = p1;
+            command->line.color = color;
+            command->line.include_last = include_last;
+        }
+        return;
+    }
+
+    Line_Batch batch;
+    if (!LineBatchMake(&batch, color)) return;
+
+    LineRasterize(&batch, x0, y0, x1, y1, include_last);
+}
+
+void DrawLine(Vector2 p0, Vector2 p1, Vector4 color)
+{
+    LineDraw(p0, p1, BlendColorFromV4(color), true);
+}
+
+void DrawLine32(Vector2 p0, Vector2 p1, Color32 color)
+{
+    LineDraw(p0, p1, BlendColorFrom32(color), true);
+}
+
+void LinesDraw(Vector2 *points, i64 count, u32 color)
+{
+    if (g_draw.deferred)
+    {
+        for (i64 i = 0; i + 1 < count; i += 2)
+        {
+            LineDraw(points[i], points[i + 1], color, true);
+        }
+        return;
+    }
+
+    Line_Batch batch;
+    if (!LineBatchMake(&batch, color)) return;
+
+    for (i64 i = 0; i + 1 < count; i += 2)
+    {
+        Vector2 p0 = points[i];
+        Vector2 p1 = points[i + 1];
+        LineRasterize(&batch, (i32)p0.x, (i32)p0.y, (i32)p1.x, (i32)p1.y, true);
+    }
+}
+
+void DrawLines(Vector2 *points, i64 count, Vector4 color)
+{
+    LinesDraw(points, count, BlendColorFromV4(color));
+}
+
+void DrawLines32(Vector2 *points, i64 count, Color32 color)
+{
+    LinesDraw(points, count, BlendColorFrom32(color));
+}
+
+void PolylineDraw(Vector2 *points, i64 count, u32 color, b32 closed)
+{
+    if (count <= 0) return;
+
+    // NOTE(nick): segments leave off their last pixel so shared points aren't blended twice
+    i64 segment_count = closed ? count : count - 1;
+
+    if (g_draw.deferred)
+    {
+        for (i64 i = 0; i < segment_count; i += 1)
+        {
+            b32 is_last = !closed && i == segment_count - 1;
+            LineDraw(points[i], points[(i + 1) % count], color, is_last);
+        }
+        if (count == 1) LineDraw(points[0], points[0], color, true);
+        return;
+    }
+
+    Line_Batch batch;
+    if (!LineBatchMake(&batch, color)) return;
+
+    for (i64 i = 0; i < segment_count; i += 1)
+    {
+        b32 is_last = !closed && i == segment_count - 1;
+        Vector2 p0 = points[i];
+        Vector2 p1 = points[(i + 1) % count];
+        LineRasterize(&batch, (i32)p0.x, (i32)p0.y, (i32)p1.x, (i32)p1.y, is_last);
+    }
+    if (count == 1) LineRasterize(&batch, (i32)points[0].x, (i32)points[0].y, (i32)points[0].x, (i32)points[0].y, true);
+}
+
+void DrawPolyline(Vector2 *points, i64 count, Vector4 color, b32 closed)
+{
+    PolylineDraw(points, count, BlendColorFromV4(color), closed);
+}
+
+void DrawPolyline32(Vector2 *points, i64 count, Color32 color, b32 closed)
+{
+    PolylineDraw(points, count, BlendColorFrom32(color), closed);
+}
+
+// NOTE(nick): blends stored texels [x0, x0 + count) of row y 1:1 into dest, skipping transparent runs
+void ImageBlendRowRuns(Image image, i32 y, i32 x0, i32 count, u32 *dest, Blend_Op op)
+{
+    Image_Spans *spans = image.spans;
+    u32 *src = image.pixels + (i64)y * ImageStride(image);
+    i32 x1 = x0 + count;
+
+    for (u32 index = spans->row_offsets[y]; index < spans->row_offsets[y + 1]; index += 1)
+    {
+        Image_Run *run = &spans->runs[index];
+        if (run->x1 <= x0) continue;
+        if (run->x0 >= x1) break;
+
+        i32 a = Max(run->x0, x0);
+        i32 b = Min(run->x1, x1);
+
+        if (run->opaque && op == BlendOp_Over)
+        {
+            MemoryCopy(dest + (a - x0), src + a, (b - a) * sizeof(u32));
+        }
+        else
+        {
+            simd_blend(op, dest + (a - x0), src + a, b - a);
+        }
+    }
+}
+
+void DrawImage(Image image, Vector2 pos)
+{
+    Rectangle2 rect = r2(pos, pos + v2_from_v2i(image.size));
+    rect = abs_r2(rect);
+
+    if (g_draw.deferred)
+    {
+        Rectangle2i bounds = r2i((i32)rect.x0, (i32)rect.y0, (i32)rect.x1, (i32)rect.y1);
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_Image, image, bounds);
+        if (command)
+        {
+            command->image.image = image;
+            command->image.pos = pos;
+        }
+        return;
+    }
+
+    Rectangle2i clip = g_draw.clip;
+    Blend_Op op = BlendOpFromMode(g_draw.blend_mode);
+
+    if (image.trimmed)
+    {
+        // NOTE(nick): copying still has to write the border that was trimmed off
+        if (op == BlendOp_Copy) RectDraw(rect, 0);
+
+        Vector2 offset = v2_from_v2i(image.trim.p0);
+        rect = r2(rect.p0 + offset, rect.p0 + offset + v2_from_v2i(r2i_size(image.trim)));
+    }
+
+    i32 in_x0 = Clamp((i32)rect.x0, clip.x0, clip.x1);
+    i32 in_y0 = Clamp((i32)rect.y0, clip.y0, clip.y1);
+
+    i32 in_x1 = Clamp((i32)rect.x1, clip.x0, clip.x1);
+    i32 in_y1 = Clamp((i32)rect.y1, clip.y0, clip.y1);
+
+    if (in_x0 == in_x1 || in_y0 == in_y1) return;
+    if (image.size.width == 0 || image.size.height == 0) return;
+
+    DrawMarkDirty(in_x0, in_y0, in_x1, in_y1);
+
+    i32 height = in_y1 - in_y0;
+    i32 width = in_x1 - in_x0;
+
+    i32 src_pos_x = in_x0 - (i32)rect.x0;
+    i32 src_pos_y = in_y0 - (i32)rect.y0;
+
+    u8 *in_data = (u8 *)image.pixels;
+    u32 in_pitch = sizeof(u32) * ImageStride(image);
+    u8 *in_line = in_data + (src_pos_y * in_pitch) + (sizeof(u32) * src_pos_x);
+
+    u8 *out_data = (u8 *)out->pixels;
+    u32 out_pitch = sizeof(u32) * out->width;
+    u8 *out_line = out_data + (in_y0 * out_pitch) + (sizeof(u32) * in_x0);
+
+    // NOTE(nick): copying has to write the transparent pixels too
+    b32 use_runs = image.spans && op != BlendOp_Copy;
+
+    for (i32 y = 0; y < height; y += 1)
+    {
+        if (use_runs)
+        {
+            ImageBlendRowRuns(image, src_pos_y + y, src_pos_x, width, (u32 *)out_line, op);
+        }
+        else
+        {
+            simd_blend(op, (u32 *)out_line, (u32 *)in_line, width);
+        }
+
+        in_line += in_pitch;
+        out_line += out_pitch;
+    }
+}
+
+//
+// NOTE(nick): image sampling
+//
+// Texture coordinates are stepped in 16.16 fixed point, set up once per call. Each destination row
+// is split into segments that never cross the edge of the image, so wrapping only happens between
+// segments and the span loops below just walk the source row.
+//
+// Samples are gathered and tinted into a small buffer and handed to the blend kernels, except for
+// the untinted 1:1 case which blends straight from the image row.
+//
+
+#define IMAGE_SPAN_CHUNK 256
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE   (1 << FIXED_SHIFT)
+
+struct Image_Span
+{
+    u32 *src;     // source row
+    i64 s;        // 16.16 position in the source row, in [0, width)
+    i64 step;     // 16.16 texels per destination pixel
+
+    Blend_Op op;
+    b32 tinted;
+    u32 tint;
+};
+
+// NOTE(nick): tints are quantized to 8 bits per channel, like every other color
+u32 ImageTintFromColor(Vector4 color, b32 premultiply)
+{
+    color.r = Clamp(color.r, 0, 1);
+    color.g = Clamp(color.g, 0, 1);
+    color.b = Clamp(color.b, 0, 1);
+    color.a = Clamp(color.a, 0, 1);
+
+    if (premultiply)
+    {
+        color.r *= color.a;
+        color.g *= color.a;
+        color.b *= color.a;
+    }
+
+    return
+        ((u32)(color.a * 255.0f + 0.5f) << 24) |
+        ((u32)(color.b * 255.0f + 0.5f) << 16) |
+        ((u32)(color.g * 255.0f + 0.5f) << 8)  |
+        ((u32)(color.r * 255.0f + 0.5f) << 0);
+}
+
+// NOTE(nick): 1:1 and mirrored 1:1, one texel per pixel
+void ImageSpanUnit(Image_Span *span, u32 *dest, i32 count)
+{
+    u32 *src = span->src + (span->s >> FIXED_SHIFT);
+    i32 dir = span->step > 0 ? 1 : -1;
+
+    if (dir > 0 && !span->tinted)
+    {
+        simd_blend(span->op, dest, src, count);
+        return;
+    }
+
+    u32 samples[IMAGE_SPAN_CHUNK];
+
+    for (i32 x = 0; x < count; x += IMAGE_SPAN_CHUNK)
+    {
+        i32 chunk = Min(IMAGE_SPAN_CHUNK, count - x);
+        if (dir > 0)
+        {
+            simd_tint(samples, src, chunk, span->tint);
+            src += chunk;
+        }
+        else
+        {
+            for (i32 i = 0; i < chunk; i += 1)
+            {
+                samples[i] = *src;
+                src -= 1;
+            }
+            if (span->tinted) simd_tint(samples, samples, chunk, span->tint);
+        }
+
+        simd_blend(span->op, dest + x, samples, chunk);
+    }
+}
+
+// NOTE(nick): magnified, every texel covers a run of pixels so we only sample once per run
+void ImageSpanRuns(Image_Span *span, u32 *dest, i32 count)
+{
+    i64 s = span->s;
+    i64 step = span->step;
+
+    i32 x = 0;
+    while (x < count)
+    {
+        i64 texel = s >> FIXED_SHIFT;
+
+        // NOTE(nick): number of steps until s leaves this texel
+        i64 run = 0;
+        if (step > 0)
+        {
+            i64 next = (texel + 1) << FIXED_SHIFT;
+            run = (next - s + step - 1) / step;
+        }
+        else
+        {
+            i64 prev = texel << FIXED_SHIFT;
+            run = (s - prev) / (-step) + 1;
+        }
+        run = Min(run, count - x);
+
+        u32 sample_color = span->src[texel];
+        if (span->tinted) sample_color = simd_tint_pixel(sample_color, span->tint);
+        Blend_Op op = BlendOpForColor(span->op, sample_color);
+        if (!BlendColorIsNoop(op, sample_color))
+        {
+            simd_blend_color(op, dest + x, sample_color, run);
+        }
+
+        x += run;
+        s += step * run;
+    }
+}
+
+// NOTE(nick): arbitrary scale
+void ImageSpanStep(Image_Span *span, u32 *dest, i32 count)
+{
+    i64 s = span->s;
+    i64 step = span->step;
+
+    u32 samples[IMAGE_SPAN_CHUNK];
+
+    for (i32 x = 0; x < count; x += IMAGE_SPAN_CHUNK)
+    {
+        i32 chunk = Min(IMAGE_SPAN_CHUNK, count - x);
+        for (i32 i = 0; i < chunk; i += 1)
+        {
+            samples[i] = span->src[s >> FIXED_SHIFT];
+            s += step;
+        }
+        if (span->tinted) simd_tint(samples, samples, chunk, span->tint);
+
+        simd_blend(span->op, dest + x, samples, chunk);
+    }
+}
+
+typedef void Image_Span_Proc(Image_Span *span, u32 *dest, i32 count);
+
+// NOTE(nick): splits a segment that steps forward through source row y into the image's runs.
+// Transparent texels are skipped and opaque ones are copied when nothing else would happen to them.
+void ImageSpanSegmentRuns(Image_Span *span, Image_Span_Proc *span_proc, Image_Spans *spans, i64 y, u32 *dest, i32 count)
+{
+    i64 s0 = span->s;
+    i64 step = span->step;
+    Blend_Op op = span->op;
+
+    i64 texel_first = s0 >> FIXED_SHIFT;
+    i64 texel_last = (s0 + (count - 1) * step) >> FIXED_SHIFT;
+
+    for (u32 index = spans->row_offsets[y]; index < spans->row_offsets[y + 1]; index += 1)
+    {
+        Image_Run *run = &spans->runs[index];
+        if (run->x1 <= texel_first) continue;
+        if (run->x0 > texel_last) break;
+
+        // NOTE(nick): first pixels that land on or past each end of the run
+        i64 i0 = 0;
+        if (run->x0 > texel_first)
+        {
+            i0 = (((i64)run->x0 << FIXED_SHIFT) - s0 + step - 1) / step;
+        }
+        i64 i1 = Min((i64)count, (((i64)run->x1 << FIXED_SHIFT) - s0 + step - 1) / step);
+        if (i0 >= i1) continue;
+
+        span->s = s0 + i0 * step;
+        span->op = (run->opaque && !span->tinted && op == BlendOp_Over) ? BlendOp_Copy : op;
+        span_proc(span, dest + i0, (i32)(i1 - i0));
+    }
+
+    span->op = op;
+}
+
+i64 FixedWrap(i64 value, i64 size)
+{
+    value %= size;
+    if (value < 0) value += size;
+    return value;
+}
+
+// NOTE(nick): per-call state that can be shared by every image in a batch
+struct Image_Batch
+{
+    Rectangle2i clip;
+    Blend_Op op;
+    b32 premultiply;
+};
+
+Image_Batch ImageBatchMake()
+{
+    Image_Batch result = {0};
+    result.clip = g_draw.clip;
+    result.op = BlendOpFromMode(g_draw.blend_mode);
+    result.premultiply = g_draw.blend_mode != Blend_None && g_draw.blend_mode != Blend_Premultiplied;
+    return result;
+}
+
+// NOTE(nick): expects rect to be normalized with abs_r2
+void ImageRasterize(Image_Batch *batch, Image image, Rectangle2 rect, Vector4 color, Rectangle2 uv)
+{
+    i32 width = (i32)r2_width(rect);
+    i32 height = (i32)r2_height(rect);
+
+    Rectangle2i clip = batch->clip;
+
+    i32 in_x0 = Clamp((i32)rect.x0, clip.x0, clip.x1);
+    i32 in_y0 = Clamp((i32)rect.y0, clip.y0, clip.y1);
+
+    i32 in_x1 = Clamp((i32)rect.x1, clip.x0, clip.x1);
+    i32 in_y1 = Clamp((i32)rect.y1, clip.y0, clip.y1);
+
+    if (in_x0 == in_x1 || in_y0 == in_y1) return;
+    if (width <= 0 || height <= 0) return;
+    if (image.size.width == 0 || image.size.height == 0) return;
+
+    DrawMarkDirty(in_x0, in_y0, in_x1, in_y1);
+
+    i32 src_pos_x = in_x0 - (i32)rect.x0;
+    i32 src_pos_y = in_y0 - (i32)rect.y0;
+
+    //
+    // NOTE(nick): pixel (x, y) samples texel (s, t) where
+    //   s = image_width  * (uv.x0 + (x + 0.5) / width  * (uv.x1 - uv.x0))
+    //   t = image_height * (uv.y0 + (y + 0.5) / height * (uv.y1 - uv.y0))
+    // wrapped around the image size.
+    //
+
+    i64 s_size = (i64)image.size.width << FIXED_SHIFT;
+    i64 t_size = (i64)image.size.height << FIXED_SHIFT;
+
+    f64 ds = image.size.width  * (uv.x1 - uv.x0) / (f64)width;
+    f64 dt = image.size.height * (uv.y1 - uv.y0) / (f64)height;
+
+    i64 s_step = round_i64(ds * FIXED_ONE) % s_size;
+    i64 t_step = round_i64(dt * FIXED_ONE) % t_size;
+
+    // NOTE(nick): step from the corner of the rect rather than the clipped corner so a rect samples
+    // the same texels no matter how it's clipped
+    i64 s_origin = floor_i64((image.size.width  * uv.x0 + 0.5 * ds) * FIXED_ONE);
+    i64 t_origin = floor_i64((image.size.height * uv.y0 + 0.5 * dt) * FIXED_ONE);
+
+    i64 s_start = FixedWrap(s_origin + src_pos_x * s_step, s_size);
+    i64 t = FixedWrap(t_origin + src_pos_y * t_step, t_size);
+
+    Image_Span_Proc *span_proc = ImageSpanStep;
+    if (s_step == FIXED_ONE || s_step == -FIXED_ONE)
+    {
+        span_proc = ImageSpanUnit;
+    }
+    else if (s_step > -FIXED_ONE && s_step < FIXED_ONE && s_step != 0)
+    {
+        span_proc = ImageSpanRuns;
+    }
+
+    Image_Span span = {0};
+    span.step = s_step;
+    span.op = batch->op;
+    span.tint = ImageTintFromColor(color, batch->premultiply);
+    span.tinted = span.tint != 0xffffffff;
+
+    Image_Spans *spans = NULL;
+    if (s_step > 0 && span.op != BlendOp_Copy) spans = image.spans;
+
+    // NOTE(nick): texels outside of the trim rect are transparent, so segments also end at its edges
+    Rectangle2i trim = ImageTrim(image);
+    i64 trim_s0 = (i64)trim.x0 << FIXED_SHIFT;
+    i64 trim_s1 = (i64)trim.x1 << FIXED_SHIFT;
+    i64 stride = ImageStride(image);
+
+    u32 *row = &out->pixels[in_y0 * out->width + in_x0];
+    i32 count = in_x1 - in_x0;
+
+    for (i32 y = in_y0; y < in_y1; y += 1)
+    {
+        i32 texel_y = (i32)(t >> FIXED_SHIFT);
+        b32 row_inside = texel_y >= trim.y0 && texel_y < trim.y1;
+        span.src = image.pixels + (texel_y - trim.y0) * stride;
+
+        i64 s = s_start;
+        i32 x = 0;
+        while (row_inside && x < count)
+        {
+            b32 inside = s >= trim_s0 && s < trim_s1;
+
+            // NOTE(nick): how many pixels until we step past the next edge
+            i64 segment = count - x;
+            if (s_step > 0)
+            {
+                i64 edge = s < trim_s0 ? trim_s0 : (s < trim_s1 ? trim_s1 : s_size);
+                segment = Min(segment, (edge - s + s_step - 1) / s_step);
+            }
+            else if (s_step < 0)
+            {
+                i64 edge = s >= trim_s1 ? trim_s1 : (s >= trim_s0 ? trim_s0 : 0);
+                segment = Min(segment, (s - edge) / (-s_step) + 1);
+            }
+
+            span.s = s - trim_s0;
+            if (!inside)
+            {
+                if (span.op == BlendOp_Copy) simd_blend_color(BlendOp_Copy, row + x, 0, (i32)segment);
+            }
+            else if (spans)
+            {
+                ImageSpanSegmentRuns(&span, span_proc, spans, texel_y - trim.y0, row + x, (i32)segment);
+            }
+            else
+            {
+                span_proc(&span, row + x, (i32)segment);
+            }
+
+            x += segment;
+            s = FixedWrap(s + s_step * segment, s_size);
+        }
+
+        if (!row_inside && span.op == BlendOp_Copy)
+        {
+            simd_blend_color(BlendOp_Copy, row, 0, count);
+        }
+
+        t += t_step;
+        if (t >= t_size) t -= t_size;
+        if (t < 0) t += t_size;
+
+        row += out->width;
+    }
+}
+
+//
+// NOTE(nick): tinted image cache
+//
+// Images that keep getting drawn with the same tint (colored text, flashing sprites) get a tinted
+// copy, so they can be drawn like an untinted image. A tint only gets a copy the second time it is
+// asked for, one-off tints (like fades) just go through the tint kernel.
+//
+// Copies that were handed out this frame are never evicted, deferred commands might still point
+// at them.
+//
+
+u32 TintCacheHash(u32 *pixels, u32 tint)
+{
+    u64 key = (u64)pixels ^ ((u64)tint * 0x9E3779B97F4A7C15);
+    return (u32)(key ^ (key >> 29));
+}
+
+void TintCacheFree(Tint_Cache_Entry *entry)
+{
+    if (entry->pixels)
+    {
+        os_free(entry->pixels);
+        g_state.tint_cache_size -= entry->size.x * entry->size.y * sizeof(u32);
+    }
+    MemoryZero(entry, sizeof(Tint_Cache_Entry));
+}
+
+b32 TintCacheMakeRoom(i64 size)
+{
+    while (g_state.tint_cache_size + size > TINT_CACHE_SIZE)
+    {
+        Tint_Cache_Entry *oldest = NULL;
+
+        for (i32 i = 0; i < count_of(g_state.tint_cache); i += 1)
+        {
+            Tint_Cache_Entry *it = &g_state.tint_cache[i];
+            if (!it->pixels || it->frame_used == g_state.frame_index) continue;
+            if (!oldest || it->last_used < oldest->last_used) oldest = it;
+        }
+
+        if (!oldest) return false;
+        TintCacheFree(oldest);
+    }
+
+    return true;
+}
+
+// NOTE(nick): swaps in the tinted copy of image and sets color to white if there is one.
+// Only call this from the main thread.
+b32 ImageTintCached(Image *image, Vector4 *color, b32 premultiply)
+{
+    if (g_draw.in_tile) return false;
+
+    u32 tint = ImageTintFromColor(*color, premultiply);
+    if (tint == 0xffffffff || !image->pixels) return false;
+
+    // NOTE(nick): only the stored texels get tinted, the copy is tightly packed
+    Vector2i stored = r2i_size(ImageTrim(*image));
+    i64 size = stored.x * stored.y * sizeof(u32);
+    if (size <= 0 || size > TINT_CACHE_SIZE / 4) return false;
+
+    g_state.tint_cache_tick += 1;
+
+    u32 set = TintCacheHash(image->pixels, tint) % TINT_CACHE_SET_COUNT;
+    Tint_Cache_Entry *ways = &g_state.tint_cache[set * TINT_CACHE_WAY_COUNT];
+
+    Tint_Cache_Entry *entry = NULL;
+    for (i32 i = 0; i < TINT_CACHE_WAY_COUNT; i += 1)
+    {
+        Tint_Cache_Entry *it = &ways[i];
+        if (it->source == image->pixels && it->tint == tint && it->size.x == stored.x && it->size.y == stored.y)
+        {
+            entry = it;
+            break;
+        }
+    }
+
+    if (!entry)
+    {
+        // NOTE(nick): replace the least recently used way that isn't in use this frame
+        for (i32 i = 0; i < TINT_CACHE_WAY_COUNT; i += 1)
+        {
+            Tint_Cache_Entry *it = &ways[i];
+            if (it->pixels && it->frame_used == g_state.frame_index) continue;
+            if (!entry || it->last_used < entry->last_used) entry = it;
+        }
+
+        if (!entry) return false;
+
+        TintCacheFree(entry);
+        entry->source = image->pixels;
+        entry->size = stored;
+        entry->tint = tint;
+        entry->last_used = g_state.tint_cache_tick;
+        return false;
+    }
+
+    entry->last_used = g_state.tint_cache_tick;
+
+    if (!entry->pixels)
+    {
+        if (!TintCacheMakeRoom(size)) return false;
+
+        entry->pixels = (u32 *)os_alloc(size);
+        if (!entry->pixels) return false;
+
+        i32 stride = ImageStride(*image);
+        for (i32 y = 0; y < stored.y; y += 1)
+        {
+            simd_tint(entry->pixels + (i64)y * stored.x, image->pixels + (i64)y * stride, stored.x, tint);
+        }
+        g_state.tint_cache_size += size;
+    }
+
+    entry->frame_used = g_state.frame_index;
+
+    image->pixels = entry->pixels;
+    image->stride = 0;
+    *color = v4_white;
+
+    // NOTE(nick): transparent pixels stay transparent, but opaque ones only stay opaque under an opaque tint
+    if ((tint >> 24) != 0xff) image->spans = NULL;
+
+    return true;
+}
+
+void DrawImageExt(Image image, Rectangle2 rect, Vector4 color, Rectangle2 uv)
+{
+    rect = abs_r2(rect);
+
+    Image_Batch batch = ImageBatchMake();
+    ImageTintCached(&image, &color, batch.premultiply);
+
+    if (g_draw.deferred)
+    {
+        Rectangle2i bounds = r2i((i32)rect.x0, (i32)rect.y0, (i32)rect.x1, (i32)rect.y1);
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_ImageExt, image_ext, bounds);
+        if (command)
+        {
+            command->image_ext.image = image;
+            command->image_ext.rect = rect;
+            command->image_ext.color = color;
+            command->image_ext.uv = uv;
+        }
+        return;
+    }
+
+    ImageRasterize(&batch, image, rect, color, uv);
+}
+
+void DrawImageMirrored(Image image, Vector2 pos, b32 flip_x, b32 flip_y)
+{
+    Rectangle2 dest = r2(pos, pos + v2_from_v2i(image.size));
+    Rectangle2 uv = r2_from_f32(0, 0, 1, 1);
+    if (flip_x) { uv.x0 = 1; uv.x1 = 0; }
+    if (flip_y) { uv.y0 = 1; uv.y1 = 0; }
+    DrawImageExt(image, dest, v4_white, uv);
+}
+
+//
+// NOTE(nick): sprite batches
+//
+// Sprites are sorted by layer and then by source image with a stable radix sort, so sprites on the
+// same layer that share an image are drawn back to back while sprites with equal keys keep the
+// order they were submitted in.
+//
+
+// NOTE(nick): sorts indices by their keys, 8 bits per pass, skipping passes where every key has the same digit
+void RadixSortU64(u64 *keys, u32 *indices, i64 count)
+{
+    if (count <= 1) return;
+
+    M_Temp scratch = GetScratch(0, 0);
+
+    u64 *src_keys = keys;
+    u32 *src_indices = indices;
+    u64 *dest_keys = PushArray(scratch.arena, u64, count);
+    u32 *dest_indices = PushArray(scratch.arena, u32, count);
+
+    for (u32 shift = 0; shift < 64; shift += 8)
+    {
+        i64 offsets[256] = {0};
+        for (i64 i = 0; i < count; i += 1)
+        {
+            offsets[(src_keys[i] >> shift) & 0xff] += 1;
+        }
+
+        if (offsets[(src_keys[0] >> shift) & 0xff] == count) continue;
+
+        i64 total = 0;
+        for (i32 digit = 0; digit < 256; digit += 1)
+        {
+            i64 digit_count = offsets[digit];
+            offsets[digit] = total;
+            total += digit_count;
+        }
+
+        for (i64 i = 0; i < count; i += 1)
+        {
+            i64 index = offsets[(src_keys[i] >> shift) & 0xff]++;
+            dest_keys[index] = src_keys[i];
+            dest_indices[index] = src_indices[i];
+        }
+
+        Swap(u64 *, src_keys, dest_keys);
+        Swap(u32 *, src_indices, dest_indices);
+    }
+
+    if (src_keys != keys)
+    {
+        MemoryCopy(keys, src_keys, sizeof(u64) * count);
+        MemoryCopy(indices, src_indices, sizeof(u32) * count);
+    }
+
+    ReleaseScratch(scratch);
+}
+
+u64 SpriteSortKey(Sprite *sprite)
+{
+    // NOTE(nick): flip the sign bit so negative layers sort first
+    u64 layer = (u32)sprite->layer ^ 0x80000000;
+    return (layer << 32) | (u32)sprite->image.index;
+}
+
+void DrawSprites(Sprite *sprites, i64 count)
+{
+    if (count <= 0) return;
+
+    M_Temp scratch = GetScratch(0, 0);
+
+    u64 *keys = PushArray(scratch.arena, u64, count);
+    u32 *order = PushArray(scratch.arena, u32, count);
+
+    for (i64 i = 0; i < count; i += 1)
+    {
+        keys[i] = SpriteSortKey(&sprites[i]);
+        order[i] = (u32)i;
+    }
+
+    RadixSortU64(keys, order, count);
+
+    b32 deferred = g_draw.deferred;
+    Image_Batch batch = ImageBatchMake();
+
+    for (i64 i = 0; i < count; i += 1)
+    {
+        Sprite *it = &sprites[order[i]];
+
+        Rectangle2 rect = abs_r2(it->rect);
+        Rectangle2 uv = it->uv;
+        if (it->flip_x) Swap(f32, uv.x0, uv.x1);
+        if (it->flip_y) Swap(f32, uv.y0, uv.y1);
+
+        if (deferred)
+        {
+            DrawImageExt(it->image, rect, it->color, uv);
+            continue;
+        }
+
+        // NOTE(nick): most sprites in a big batch are tiny or off screen, so reject early
+        if ((i32)rect.x1 <= batch.clip.x0 || (i32)rect.x0 >= batch.clip.x1) continue;
+        if ((i32)rect.y1 <= batch.clip.y0 || (i32)rect.y0 >= batch.clip.y1) continue;
+
+        Image image = it->image;
+        Vector4 color = it->color;
+        ImageTintCached(&image, &color, batch.premultiply);
+
+        ImageRasterize(&batch, image, rect, color, uv);
+    }
+
+    ReleaseScratch(scratch);
+}
+
+//
+// NOTE(nick): Render targets
+//
+
+Image ImageMake(Vector2i size)
+{
+    Image result = {0};
+    if (size.x <= 0 || size.y <= 0) return result;
+
+    result.size = size;
+    result.pixels = PushArrayZero(g_state.arena, u32, size.x * size.y);
+    return result;
+}
+
+// NOTE(nick): tinted copies of the old pixels would be used instead of the new ones
+void TintCacheInvalidate(u32 *source)
+{
+    for (i32 i = 0; i < count_of(g_state.tint_cache); i += 1)
+    {
+        Tint_Cache_Entry *it = &g_state.tint_cache[i];
+        if (it->source == source) TintCacheFree(it);
+    }
+}
+
+// NOTE(nick): LoadImage hands out copies of the cached image, so they have to match the target
+void ImageSetSpans(Image *image, Image_Spans *spans)
+{
+    image->spans = spans;
+
+    for (i32 i = 0; i < count_of(g_state.images); i += 1)
+    {
+        Image_Asset *it = &g_state.images[i];
+        if (it->image.pixels == image->pixels) it->image.spans = spans;
+    }
+}
+
+void BeginDrawToImage(Image *image)
+{
+    assert(g_state.target_count < DRAW_TARGET_STACK_SIZE);
+    if (g_state.target_count >= DRAW_TARGET_STACK_SIZE) return;
+
+    // NOTE(nick): commands recorded so far might read from the image
+    if (g_draw.deferred) DrawFlushDeferred();
+
+    Draw_Target *target = &g_state.targets[g_state.target_count];
+    g_state.target_count += 1;
+
+    target->image = NULL;
+    target->prev_out = out;
+    target->prev_draw = g_draw;
+    target->prev_clip_stack_count = g_state.clip_stack_count;
+
+    // NOTE(nick): images that can't be drawn to get an empty target, so nothing gets drawn
+    MemoryZero(&target->output, sizeof(Game_Output));
+
+    b32 is_packed = image && (image->stride == 0 || image->stride == image->size.x);
+    assert(image && image->pixels && is_packed && !image->trimmed);
+
+    if (image && image->pixels && is_packed && !image->trimmed)
+    {
+        target->image = image;
+        target->output.width = image->size.x;
+        target->output.height = image->size.y;
+        target->output.pixels = image->pixels;
+
+        // NOTE(nick): the runs would skip pixels that get drawn over, they get rebuilt at the end
+        ImageSetSpans(image, NULL);
+    }
+
+    out = &target->output;
+
+    g_draw.deferred = false;
+    g_draw.clip = r2i(0, 0, out->width, out->height);
+}
+
+void EndDrawToImage()
+{
+    assert(g_state.target_count > 0);
+    if (g_state.target_count <= 0) return;
+
+    g_state.target_count -= 1;
+    Draw_Target *target = &g_state.targets[g_state.target_count];
+
+    if (target->image)
+    {
+        Image *image = target->image;
+        TintCacheInvalidate(image->pixels);
+
+        Draw_Target_Spans *slot = NULL;
+        for (i32 i = 0; i < count_of(g_state.target_spans); i += 1)
+        {
+            Draw_Target_Spans *it = &g_state.target_spans[i];
+            if (it->pixels == image->pixels) { slot = it; break; }
+            if (!slot && !it->pixels) slot = it;
+        }
+
+        // NOTE(nick): without a slot the image is just drawn without runs
+        if (slot)
+        {
+            if (slot->spans) os_free(slot->spans);
+
+            slot->pixels = image->pixels;
+            slot->spans = ImageSpansAlloc(*image);
+            ImageSetSpans(image, slot->spans);
+        }
+    }
+
+    out = target->prev_out;
+    g_draw = target->prev_draw;
+    g_state.clip_stack_count = target->prev_clip_stack_count;
+}
+
+//
+// NOTE(nick): Tilemaps
+//
+
+Tilemap TilemapMake(Image tileset, Vector2i tile_size, Vector2i size, i32 chunk_size)
+{
+    Tilemap result = {0};
+    if (tile_size.x <= 0 || tile_size.y <= 0 || size.x <= 0 || size.y <= 0) return result;
+
+    if (chunk_size <= 0) chunk_size = 16;
+
+    result.size = size;
+    result.tileset = tileset;
+    result.tile_size = tile_size;
+    result.chunk_size = chunk_size;
+
+    result.chunk_count.x = (size.x + chunk_size - 1) / chunk_size;
+    result.chunk_count.y = (size.y + chunk_size - 1) / chunk_size;
+
+    result.tiles = PushArrayZero(g_state.arena, u16, size.x * size.y);
+    result.chunks = PushArrayZero(g_state.arena, Tilemap_Chunk, result.chunk_count.x * result.chunk_count.y);
+
+    TilemapInvalidate(&result);
+
+    return result;
+}
+
+void TilemapInvalidate(Tilemap *map)
+{
+    i32 chunk_count = map->chunk_count.x * map->chunk_count.y;
+    for (i32 i = 0; i < chunk_count; i += 1)
+    {
+        map->chunks[i].dirty = true;
+    }
+}
+
+void TilemapSetTile(Tilemap *map, i32 x, i32 y, u16 tile)
+{
+    if (x < 0 || x >= map->size.x || y < 0 || y >= map->size.y) return;
+
+    u16 *at = &map->tiles[y * map->size.x + x];
+    if (*at == tile) return;
+
+    *at = tile;
+
+    i32 chunk_index = (y / map->chunk_size) * map->chunk_count.x + (x / map->chunk_size);
+    map->chunks[chunk_index].dirty = true;
+}
+
+u16 TilemapGetTile(Tilemap *map, i32 x, i32 y)
+{
+    if (x < 0 || x >= map->size.x || y < 0 || y >= map->size.y) return 0;
+
+    return map->tiles[y * map->size.x + x];
+}
+
+// NOTE(nick): copies one tileset cell into dest, tiles never overlap so nothing has to be blended
+void TilemapCopyTile(Tilemap *map, u16 tile, u32 *dest, i32 dest_stride)
+{
+    Image tileset = map->tileset;
+    Vector2i tile_size = map->tile_size;
+
+    i32 cells_x = tileset.size.x / tile_size.x;
+    i32 cells_y = tileset.size.y / tile_size.y;
+
+    i32 cell = tile - 1;
+    if (cells_x <= 0 || cell >= cells_x * cells_y) return;
+
+    i32 sx = (cell % cells_x) * tile_size.x;
+    i32 sy = (cell / cells_x) * tile_size.y;
+
+    // NOTE(nick): only the stored texels are copied, the trimmed border is already transparent
+    Rectangle2i trim = ImageTrim(tileset);
+    i32 x0 = Max(sx, trim.x0);
+    i32 x1 = Min(sx + tile_size.x, trim.x1);
+    i32 y0 = Max(sy, trim.y0);
+    i32 y1 = Min(sy + tile_size.y, trim.y1);
+    if (x0 >= x1) return;
+
+    i32 stride = ImageStride(tileset);
+
+    for (i32 y = y0; y < y1; y += 1)
+    {
+        u32 *src = tileset.pixels + (i64)(y - trim.y0) * stride + (x0 - trim.x0);
+        MemoryCopy(dest + (i64)(y - sy) * dest_stride + (x0 - sx), src, (x1 - x0) * sizeof(u32));
+    }
+}
+
+void TilemapChunkRender(Tilemap *map, i32 chunk_x, i32 chunk_y)
+{
+    Tilemap_Chunk *chunk = &map->chunks[chunk_y * map->chunk_count.x + chunk_x];
+    chunk->dirty = false;
+
+    if (chunk->image.spans)
+    {
+        os_free(chunk->image.spans);
+        chunk->image.spans = NULL;
+    }
+
+    i32 tile_x0 = chunk_x * map->chunk_size;
+    i32 tile_y0 = chunk_y * map->chunk_size;
+    i32 tile_x1 = Min(tile_x0 + map->chunk_size, map->size.x);
+    i32 tile_y1 = Min(tile_y0 + map->chunk_size, map->size.y);
+
+    // NOTE(nick): empty chunks don't get any pixels
+    chunk->empty = true;
+    for (i32 y = tile_y0; y < tile_y1 && chunk->empty; y += 1)
+    {
+        for (i32 x = tile_x0; x < tile_x1; x += 1)
+        {
+            if (map->tiles[y * map->size.x + x]) { chunk->empty = false; break; }
+        }
+    }
+
+    if (chunk->empty || !map->tileset.pixels)
+    {
+        chunk->empty = true;
+        return;
+    }
+
+    Vector2i size = v2i((tile_x1 - tile_x0) * map->tile_size.x, (tile_y1 - tile_y0) * map->tile_size.y);
+
+    if (!chunk->image.pixels)
+    {
+        chunk->image.size = size;
+        chunk->image.pixels = PushArray(g_state.arena, u32, size.x * size.y);
+    }
+
+    MemoryZero(chunk->image.pixels, size.x * size.y * sizeof(u32));
+
+    for (i32 y = tile_y0; y < tile_y1; y += 1)
+    {
+        for (i32 x = tile_x0; x < tile_x1; x += 1)
+        {
+            u16 tile = map->tiles[y * map->size.x + x];
+            if (!tile) continue;
+
+            u32 *dest = chunk->image.pixels + (i64)(y - tile_y0) * map->tile_size.y * size.x + (x - tile_x0) * map->tile_size.x;
+            TilemapCopyTile(map, tile, dest, size.x);
+        }
+    }
+
+    chunk->image.spans = ImageSpansAlloc(chunk->image);
+}
+
+void DrawTilemap(Tilemap *map, Vector2 pos)
+{
+    if (!map->chunks) return;
+
+    // NOTE(nick): whole pixels keep the chunk edges lined up
+    pos = v2(floor_f32(pos.x), floor_f32(pos.y));
+
+    i32 chunk_w = map->chunk_size * map->tile_size.x;
+    i32 chunk_h = map->chunk_size * map->tile_size.y;
+
+    Rectangle2i clip = g_draw.clip;
+    i32 origin_x = (i32)pos.x;
+    i32 origin_y = (i32)pos.y;
+
+    i32 cx0 = (i32)Max(FloorDivI64(clip.x0 - origin_x, chunk_w), 0);
+    i32 cy0 = (i32)Max(FloorDivI64(clip.y0 - origin_y, chunk_h), 0);
+    i32 cx1 = (i32)Min(FloorDivI64(clip.x1 - 1 - origin_x, chunk_w) + 1, map->chunk_count.x);
+    i32 cy1 = (i32)Min(FloorDivI64(clip.y1 - 1 - origin_y, chunk_h) + 1, map->chunk_count.y);
+
+    for (i32 cy = cy0; cy < cy1; cy += 1)
+    {
+        for (i32 cx = cx0; cx < cx1; cx += 1)
+        {
+            Tilemap_Chunk *chunk = &map->chunks[cy * map->chunk_count.x + cx];
+
+            if (chunk->dirty)
+            {
+                // NOTE(nick): recorded commands still point at the old pixels and spans
+                if (g_draw.deferred) DrawFlushDeferred();
+
+                TilemapChunkRender(map, cx, cy);
+            }
+
+            if (chunk->empty) continue;
+
+            DrawImage(chunk->image, v2(origin_x + cx * chunk_w, origin_y + cy * chunk_h));
+        }
+    }
+}
+
+//
+// NOTE(nick): Particles
+//
+
+// NOTE(nick): updates smaller than this many particles per job stay on the calling thread
+#define PARTICLE_JOB_MIN_SIZE 8192
+#define PARTICLE_JOB_MAX_COUNT 64
+
+#define PARTICLE_DRAW_BATCH_SIZE 256
+
+Particle_System ParticleSystemMake(i32 capacity, i32 emitter_capacity)
+{
+    Particle_System result = {0};
+    if (capacity <= 0) return result;
+
+    // NOTE(nick): padded to a whole number of lanes so updates never need a scalar tail
+    i32 padded = (capacity + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+
+    Arena *arena = g_state.arena;
+
+    f32 **fields[] = {
+        &result.x, &result.y, &result.vx, &result.vy, &result.life, &result.size,
+        &result.r, &result.g, &result.b, &result.a, &result.dr, &result.dg, &result.db, &result.da,
+    };
+    for (i32 i = 0; i < count_of(fields); i += 1)
+    {
+        *fields[i] = PushArrayZero(arena, f32, padded);
+    }
+
+    result.capacity = capacity;
+
+    if (emitter_capacity > 0)
+    {
+        result.emitters = PushArrayZero(arena, Particle_Emitter, emitter_capacity);
+        result.emitter_capacity = emitter_capacity;
+    }
+
+    return result;
+}
+
+Particle_Emitter *ParticleEmitterAdd(Particle_System *system)
+{
+    for (i32 i = 0; i < system->emitter_capacity; i += 1)
+    {
+        Particle_Emitter *it = &system->emitters[i];
+        if (!it->active)
+        {
+            MemoryZero(it, sizeof(Particle_Emitter));
+            it->active = true;
+            it->lifetime = 1;
+            it->start_color = v4_white;
+            it->end_color = v4(1, 1, 1, 0);
+            it->size = 1;
+            return it;
+        }
+    }
+
+    return NULL;
+}
+
+void ParticleEmitterRemove(Particle_System *system, Particle_Emitter *emitter)
+{
+    if (emitter) emitter->active = false;
+}
+
+void ParticleEmit(Particle_System *system, Particle_Emitter *emitter, i32 count)
+{
+    Random_PCG *rng = &g_state.rng;
+
+    count = Min(count, system->capacity - system->count);
+
+    for (i32 n = 0; n < count; n += 1)
+    {
+        i32 i = system->count;
+        system->count += 1;
+
+        f32 lifetime = emitter->lifetime + random_pcg_between_f32(rng, -emitter->lifetime_spread, emitter->lifetime_spread);
+        lifetime = Max(lifetime, 0.001f);
+
+        system->x[i]  = emitter->pos.x + random_pcg_between_f32(rng, -emitter->pos_spread.x, emitter->pos_spread.x);
+        system->y[i]  = emitter->pos.y + random_pcg_between_f32(rng, -emitter->pos_spread.y, emitter->pos_spread.y);
+        system->vx[i] = emitter->velocity.x + random_pcg_between_f32(rng, -emitter->velocity_spread.x, emitter->velocity_spread.x);
+        system->vy[i] = emitter->velocity.y + random_pcg_between_f32(rng, -emitter->velocity_spread.y, emitter->velocity_spread.y);
+        system->life[i] = lifetime;
+        system->size[i] = emitter->size;
+
+        // NOTE(nick): colors are stepped by a constant rate, so they land on end_color as the particle dies
+        Vector4 c0 = emitter->start_color;
+        Vector4 dc = (emitter->end_color - c0) * (1.0f / lifetime);
+
+        system->r[i] = c0.r; system->dr[i] = dc.r;
+        system->g[i] = c0.g; system->dg[i] = dc.g;
+        system->b[i] = c0.b; system->db[i] = dc.b;
+        system->a[i] = c0.a; system->da[i] = dc.a;
+    }
+}
+
+struct Particle_Update_Job
+{
+    Particle_System *system;
+    i32 start;
+    i32 end;
+    f32 dt;
+};
+
+void ParticleIntegrate(Particle_System *system, i32 start, i32 end, f32 dt)
+{
+    f32 damping = Max(1 - system->drag * dt, 0);
+
+    Lane_F32 dt_lane = lane_f32_set1(dt);
+    Lane_F32 damping_lane = lane_f32_set1(damping);
+    Lane_F32 gx = lane_f32_set1(system->gravity.x * dt);
+    Lane_F32 gy = lane_f32_set1(system->gravity.y * dt);
+
+    f32 *colors[4] = {system->r, system->g, system->b, system->a};
+    f32 *color_steps[4] = {system->dr, system->dg, system->db, system->da};
+
+    for (i32 i = start; i < end; i += LANE_WIDTH)
+    {
+        Lane_F32 vx = (lane_f32_load(system->vx + i) + gx) * damping_lane;
+        Lane_F32 vy = (lane_f32_load(system->vy + i) + gy) * damping_lane;
+        lane_f32_store(system->vx + i, vx);
+        lane_f32_store(system->vy + i, vy);
+
+        lane_f32_store(system->x + i, lane_f32_load(system->x + i) + vx * dt_lane);
+        lane_f32_store(system->y + i, lane_f32_load(system->y + i) + vy * dt_lane);
+
+        lane_f32_store(system->life + i, lane_f32_load(system->life + i) - dt_lane);
+
+        for (i32 c = 0; c < 4; c += 1)
+        {
+            Lane_F32 value = lane_f32_load(colors[c] + i) + lane_f32_load(color_steps[c] + i) * dt_lane;
+            lane_f32_store(colors[c] + i, value);
+        }
+    }
+}
+
+void ParticleUpdateWorkerProc(void *data)
+{
+    Particle_Update_Job *job = (Particle_Update_Job *)data;
+    ParticleIntegrate(job->system, job->start, job->end, job->dt);
+}
+
+void ParticleSystemUpdate(Particle_System *system, f32 dt)
+{
+    for (i32 i = 0; i < system->emitter_capacity; i += 1)
+    {
+        Particle_Emitter *it = &system->emitters[i];
+        if (!it->active || it->rate <= 0) continue;
+
+        it->emit_accumulator += it->rate * dt;
+        i32 count = (i32)it->emit_accumulator;
+        it->emit_accumulator -= count;
+
+        ParticleEmit(system, it, count);
+    }
+
+    // NOTE(nick): lanes past count read and write padding, which is never drawn
+    i32 padded_count = (system->count + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+
+    i32 job_count = 1;
+    if (system->use_work_queue)
+    {
+        job_count = Min(padded_count / PARTICLE_JOB_MIN_SIZE, (i32)g_state.worker_count + 1);
+        job_count = Min(job_count, PARTICLE_JOB_MAX_COUNT);
+    }
+
+    if (job_count > 1)
+    {
+        Particle_Update_Job jobs[PARTICLE_JOB_MAX_COUNT];
+
+        i32 lane_count = padded_count / LANE_WIDTH;
+        for (i32 i = 0; i < job_count; i += 1)
+        {
+            jobs[i].system = system;
+            jobs[i].start = (i32)((i64)lane_count * i / job_count) * LANE_WIDTH;
+            jobs[i].end = (i32)((i64)lane_count * (i + 1) / job_count) * LANE_WIDTH;
+            jobs[i].dt = dt;
+
+            work_queue_add_entry(&g_state.work_queue, ParticleUpdateWorkerProc, &jobs[i]);
+        }
+
+        work_queue_complete_all_work(&g_state.work_queue);
+    }
+    else
+    {
+        ParticleIntegrate(system, 0, padded_count, dt);
+    }
+
+    // NOTE(nick): dead particles are replaced by the last live one, so the order isn't kept
+    f32 *fields[] = {
+        system->x, system->y, system->vx, system->vy, system->life, system->size,
+        system->r, system->g, system->b, system->a, system->dr, system->dg, system->db, system->da,
+    };
+
+    i32 i = 0;
+    while (i < system->count)
+    {
+        if (system->life[i] > 0)
+        {
+            i += 1;
+            continue;
+        }
+
+        system->count -= 1;
+        i32 last = system->count;
+        for (i32 f = 0; f < count_of(fields); f += 1)
+        {
+            fields[f][i] = fields[f][last];
+        }
+    }
+}
+
+void DrawParticles(Particle_System *system)
+{
+    if (system->count <= 0) return;
+
+    if (g_draw.deferred) DrawFlushDeferred();
+
+    Blend_Mode mode = g_draw.blend_mode;
+    Blend_Op op = BlendOpFromMode(mode);
+    b32 premultiply = mode != Blend_None && mode != Blend_Premultiplied;
+
+    Rectangle2i clip = g_draw.clip;
+
+    Lane_F32 zero = lane_f32_set1(0);
+    Lane_F32 one = lane_f32_set1(1);
+    Lane_F32 scale = lane_f32_set1(255);
+
+    u32 colors[PARTICLE_DRAW_BATCH_SIZE];
+
+    for (i32 batch_start = 0; batch_start < system->count; batch_start += PARTICLE_DRAW_BATCH_SIZE)
+    {
+        i32 batch_count = Min(system->count - batch_start, PARTICLE_DRAW_BATCH_SIZE);
+
+        // NOTE(nick): same as BlendColorFromV4, a lane at a time
+        for (i32 i = 0; i < batch_count; i += LANE_WIDTH)
+        {
+            i32 at = batch_start + i;
+
+            Lane_F32 a = lane_f32_min(lane_f32_max(lane_f32_load(system->a + at), zero), one);
+            Lane_F32 r = lane_f32_min(lane_f32_max(lane_f32_load(system->r + at), zero), one);
+            Lane_F32 g = lane_f32_min(lane_f32_max(lane_f32_load(system->g + at), zero), one);
+            Lane_F32 b = lane_f32_min(lane_f32_max(lane_f32_load(system->b + at), zero), one);
+
+            if (premultiply)
+            {
+                r = r * a;
+                g = g * a;
+                b = b * a;
+            }
+
+            Lane_U32 color =
+                lane_u32_shl(lane_u32_from_f32(a * scale), 24) |
+                lane_u32_shl(lane_u32_from_f32(b * scale), 16) |
+                lane_u32_shl(lane_u32_from_f32(g * scale), 8) |
+                lane_u32_from_f32(r * scale);
+
+            lane_u32_store(colors + i, color);
+        }
+
+        // NOTE(nick): each particle marks its own tiles, a bounding box of scattered particles would
+        // cover most of the screen
+        for (i32 i = 0; i < batch_count; i += 1)
+        {
+            i32 index = batch_start + i;
+
+            u32 color = colors[i];
+            Blend_Op color_op = BlendOpForColor(op, color);
+            if (BlendColorIsNoop(color_op, color)) continue;
+
+            f32 size = system->size[index];
+            f32 px = system->x[index];
+            f32 py = system->y[index];
+
+            if (size <= 1)
+            {
+                i32 x = (i32)px;
+                i32 y = (i32)py;
+                if (x < clip.x0 || x >= clip.x1 || y < clip.y0 || y >= clip.y1) continue;
+
+                simd_blend_pixel(color_op, &out->pixels[y * out->width + x], color);
+                DrawMarkDirty(x, y, x + 1, y + 1);
+                continue;
+            }
+
+            // NOTE(nick): same pixels as DrawRect of a size x size rect centered on the particle
+            f32 half = size * 0.5f;
+            i32 x0 = Clamp((i32)(px - half), clip.x0, clip.x1);
+            i32 x1 = Clamp((i32)(px + half), clip.x0, clip.x1);
+            i32 y0 = Clamp((i32)(py - half), clip.y0, clip.y1);
+            i32 y1 = Clamp((i32)(py + half), clip.y0, clip.y1);
+            if (x0 >= x1 || y0 >= y1) continue;
+
+            u32 *row = &out->pixels[y0 * out->width + x0];
+            for (i32 y = y0; y < y1; y += 1)
+            {
+                simd_blend_color(color_op, row, color, x1 - x0);
+                row += out->width;
+            }
+
+            DrawMarkDirty(x0, y0, x1, y1);
+        }
+    }
+}
+
+u32 FontGlyphIndex(Font font, u32 character)
+{
+    Font_Glyph_Table *table = font.table;
+
+    if (table)
+    {
+        if (character < count_of(table->latin1))
+        {
+            return table->latin1[character];
+        }
+
+        if (table->values)
+        {
+            u32 slot = FontGlyphHash(character) & table->mask;
+            while (table->values[slot])
+            {
+                if (table->keys[slot] == character) return table->values[slot];
+                slot = (slot + 1) & table->mask;
+            }
+        }
+
+        return 0;
+    }
+
+    // NOTE(nick): fonts put together by hand don't have a table
+    for (u32 index = 1; index < font.glyph_count; index += 1)
+    {
+        if (font.glyphs[index].character == character) return index;
+    }
+
+    return 0;
+}
+
+Font_Glyph FontGetGlyph(Font font, u32 character)
+{
+    return font.glyphs[FontGlyphIndex(font, character)];
+}
+
+i32 FontLineHeight(Font font)
+{
+    if (font.table) return font.table->line_height;
+
+    i32 result = 0;
+    for (u32 index = 0; index < font.glyph_count; index += 1)
+    {
+        result = Max(result, font.glyphs[index].size.y);
+    }
+    return result;
+}
+
+//
+// NOTE(nick): Text Layout
+//
+
+Text_Layout *TextLayoutFind(Font font, String text, f32 max_width, u64 hash)
+{
+    u32 mask = count_of(g_state.text_layouts) - 1;
+    u32 slot = (u32)hash & mask;
+
+    while (g_state.text_layouts[slot].hash)
+    {
+        Text_Layout *it = &g_state.text_layouts[slot];
+        if (
+            it->hash == hash && it->glyphs_key == font.glyphs && it->max_width == max_width &&
+            it->image_size.x == font.image.size.x && it->image_size.y == font.image.size.y &&
+            string_equals(it->text, text)
+        )
+        {
+            return it;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return &g_state.text_layouts[slot];
+}
+
+// NOTE(nick): positions are relative to the top left of the text and unscaled.
+// A max_width of zero lays everything out on one line, same as MeasureText always has.
+void TextLayoutBuild(Text_Layout *layout, Font font, String32 text, f32 max_width)
+{
+    Arena *arena = g_state.text_arena;
+
+    b32 wrap = max_width > 0;
+    f32 line_height = (f32)FontLineHeight(font);
+    Vector2 image_size = v2_from_v2i(font.image.size);
+
+    Text_Glyph *glyphs = PushArray(arena, Text_Glyph, text.count);
+    i64 glyph_count = 0;
+
+    f32 x = 0;
+    f32 y = 0;
+    f32 width = 0;
+    f32 height = 0;
+    i32 line_count = 1;
+
+    // NOTE(nick): x after the last non-space glyph on the line
+    f32 word_end_x = 0;
+
+    // NOTE(nick): where the line can be broken if the next word doesn't fit
+    i64 line_first = 0;
+    i64 break_glyph = 0;
+    f32 break_x = 0;
+    f32 break_width = 0;
+
+    for (i64 i = 0; i < text.count; i += 1)
+    {
+        u32 character = text.data[i];
+
+        if (wrap && character == '\n')
+        {
+            width = Max(width, word_end_x);
+            x = 0;
+            word_end_x = 0;
+            y += line_height;
+            line_count += 1;
+            line_first = break_glyph = glyph_count;
+            continue;
+        }
+
+        Font_Glyph glyph = FontGetGlyph(font, character);
+
+        if (wrap && character != ' ' && x > 0 && x + glyph.xadvance > max_width)
+        {
+            if (break_glyph > line_first)
+            {
+                // NOTE(nick): move the word that didn't fit down to the next line
+                for (i64 g = break_glyph; g < glyph_count; g += 1)
+                {
+                    glyphs[g].rect.x0 -= break_x;
+                    glyphs[g].rect.x1 -= break_x;
+                    glyphs[g].rect.y0 += line_height;
+                    glyphs[g].rect.y1 += line_height;
+                }
+
+                width = Max(width, break_width);
+                x -= break_x;
+                word_end_x -= break_x;
+                line_first = break_glyph;
+            }
+            else
+            {
+                width = Max(width, word_end_x);
+                x = 0;
+                word_end_x = 0;
+                line_first = break_glyph = glyph_count;
+            }
+
+            y += line_height;
+            line_count += 1;
+        }
+
+        Vector2 pos = v2(x, y) + v2_from_v2i(glyph.line_offset);
+        Vector2 size = v2_from_v2i(glyph.size);
+
+        if (size.x > 0 && size.y > 0)
+        {
+            Text_Glyph *it = &glyphs[glyph_count];
+            glyph_count += 1;
+
+            it->rect = r2(pos, pos + size);
+            it->uv = r2(
+                (v2_from_v2i(glyph.pos)) / image_size,
+                (v2_from_v2i(glyph.pos) + size) / image_size
+            );
+        }
+
+        x += glyph.xadvance;
+        height = Max(height, (f32)glyph.size.y);
+
+        if (wrap && character == ' ')
+        {
+            break_glyph = glyph_count;
+            break_x = x;
+            break_width = word_end_x;
+        }
+        else
+        {
+            word_end_x = x;
+        }
+    }
+
+    if (wrap)
+    {
+        width = Max(width, word_end_x);
+        height = line_count * line_height;
+    }
+    else
+    {
+        width = x;
+    }
+
+    Rectangle2 bounds = {0};
+    for (i64 g = 0; g < glyph_count; g += 1)
+    {
+        Rectangle2 rect = glyphs[g].rect;
+        if (g == 0) bounds = rect;
+        bounds.x0 = Min(bounds.x0, rect.x0);
+        bounds.y0 = Min(bounds.y0, rect.y0);
+        bounds.x1 = Max(bounds.x1, rect.x1);
+        bounds.y1 = Max(bounds.y1, rect.y1);
+    }
+
+    layout->glyphs = glyphs;
+    layout->glyph_count = glyph_count;
+    layout->size = v2(width, height);
+    layout->line_count = line_count;
+    layout->bounds = bounds;
+}
+
+Text_Layout *TextLayoutGet(Font font, String text, f32 max_width)
+{
+    if (max_width < 0) max_width = 0;
+
+    u64 seed = (u64)font.glyphs ^ ((u64)font.image.size.x << 32) ^ (u64)font.image.size.y;
+    u64 hash = murmur64_seed(text.data, text.count, seed ^ (u64)(i64)(max_width * 64));
+    if (hash == 0) hash = 1;
+
+    Text_Layout *result = TextLayoutFind(font, text, max_width, hash);
+    if (result->hash) return result;
+
+    // NOTE(nick): most text doesn't change from frame to frame, so layouts live until the cache fills up
+    if (
+        g_state.text_layout_count + 1 > count_of(g_state.text_layouts) * 3 / 4 ||
+        g_state.text_arena->pos > TEXT_CACHE_SIZE
+    )
+    {
+        arena_reset(g_state.text_arena);
+        MemoryZero(g_state.text_layouts, sizeof(g_state.text_layouts));
+        g_state.text_layout_count = 0;
+
+        result = TextLayoutFind(font, text, max_width, hash);
+    }
+
+    M_Temp scratch = GetScratch(0, 0);
+    String32 unicode_text = string32_from_string(scratch.arena, text);
+
+    result->hash = hash;
+    result->glyphs_key = font.glyphs;
+    result->image_size = font.image.size;
+    result->max_width = max_width;
+    result->text = string_push(g_state.text_arena, text);
+    TextLayoutBuild(result, font, unicode_text, max_width);
+    g_state.text_layout_count += 1;
+
+    ReleaseScratch(scratch);
+
+    return result;
+}
+
+void TextLayoutDraw(Font font, Text_Layout *layout, Vector2 pos, Vector4 color, Vector2 anchor, f32 scale)
+{
+    if (scale <= 0) scale = 1.0;
+
+    Vector2 origin = pos - layout->size * anchor * scale;
+
+    if (layout->glyph_count == 0) return;
+
+    // NOTE(nick): skip text that's entirely clipped without looking at any of its glyphs
+    Rectangle2 bounds = r2(origin + layout->bounds.p0 * scale, origin + layout->bounds.p1 * scale);
+    Rectangle2i clip = g_draw.clip;
+    if ((i32)bounds.x1 <= clip.x0 || (i32)bounds.x0 >= clip.x1) return;
+    if ((i32)bounds.y1 <= clip.y0 || (i32)bounds.y0 >= clip.y1) return;
+
+    b32 deferred = g_draw.deferred;
+    Image_Batch batch = ImageBatchMake();
+    if (BlendColorIsNoop(batch.op, BlendColorFromV4(color))) return;
+
+    Image image = font.image;
+    ImageTintCached(&image, &color, batch.premultiply);
+
+    for (i64 i = 0; i < layout->glyph_count; i += 1)
+    {
+        Text_Glyph *it = &layout->glyphs[i];
+        Rectangle2 rect = r2(origin + v2(it->rect.x0, it->rect.y0) * scale, origin + v2(it->rect.x1, it->rect.y1) * scale);
+
+        if (deferred)
+        {
+            DrawImageExt(image, rect, color, it->uv);
+            continue;
+        }
+
+        if ((i32)rect.x1 <= batch.clip.x0 || (i32)rect.x0 >= batch.clip.x1) continue;
+        if ((i32)rect.y1 <= batch.clip.y0 || (i32)rect.y0 >= batch.clip.y1) continue;
+
+        ImageRasterize(&batch, image, rect, color, it->uv);
+    }
+}
+
+Vector2 MeasureText(Font font, String text)
+{
+    return TextLayoutGet(font, text, 0)->size;
+}
+
+Vector2 MeasureTextWrapped(Font font, String text, f32 max_width)
+{
+    return TextLayoutGet(font, text, max_width)->size;
+}
+
+void DrawTextExt(Font font, String text, Vector2 pos, Vector4 color, Vector2 anchor, f32 scale)
+{
+    TextLayoutDraw(font, TextLayoutGet(font, text, 0), pos, color, anchor, scale);
+}
+
+void DrawTextWrapped(Font font, String text, Vector2 pos, Vector4 color, Vector2 anchor, f32 scale, f32 max_width)
+{
+    if (scale <= 0) scale = 1.0;
+    TextLayoutDraw(font, TextLayoutGet(font, text, max_width / scale), pos, color, anchor, scale);
+}
+
+void DrawText(Font font, String text, Vector2 pos)
+{
+    DrawTextExt(font, text, pos, v4_white, v2_zero, 1);
+}
+
+void DrawTextAlign(Font font, String text, Vector2 pos, Vector2 anchor)
+{
+    DrawTextExt(font, text, pos, v4_white, anchor, 1);
+}
+
+// NOTE(nick): past this size the framebuffer won't be sitting in cache anyway, so a clear
+// shouldn't evict everything else on its way to memory
+#define DRAW_CLEAR_STREAM_THRESHOLD Megabytes(1)
+
+void ClearDraw(u32 color)
+{
+    if (g_draw.deferred)
+    {
+        Draw_Command *command = DrawPushCommandMember(DrawCommand_Clear, clear, r2i(0, 0, out->width, out->height));
+        if (command)
+        {
+            command->clear.color = color;
+        }
+        return;
+    }
+
+    u32 out_color = color;
+    Rectangle2i clip = g_draw.clip;
+
+    DrawMarkDirty(clip.x0, clip.y0, clip.x1, clip.y1);
+
+    if (clip.x0 != 0 || clip.y0 != 0 || clip.x1 != out->width || clip.y1 != out->height)
+    {
+        i32 width = clip.x1 - clip.x0;
+        if (width <= 0) return;
+
+        u32 *at = &out->pixels[clip.y0 * out->width + clip.x0];
+        for (i32 y = clip.y0; y < clip.y1; y += 1)
+        {
+            simd_fill_u32(at, out_color, width);
+            at += out->width;
+        }
+        return;
+    }
+
+    i64 pixel_count = (i64)out->width * (i64)out->height;
+
+    if (pixel_count * sizeof(u32) >= DRAW_CLEAR_STREAM_THRESHOLD)
+    {
+        simd_fill_u32_stream(out->pixels, out_color, pixel_count);
+    }
+    else
+    {
+        simd_fill_u32(out->pixels, out_color, pixel_count);
+    }
+}
+
+// NOTE(nick): clears ignore the blend mode, the color is written as is
+void DrawClear(Vector4 color)
+{
+    ClearDraw(u32_rgba_from_v4(color));
+}
+
+void DrawClear32(Color32 color)
+{
+    ClearDraw(color);
+}
+
+//
+// NOTE(nick): palette mode
+//
+// The screen is an 8-bit index buffer that the platform looks up in the palette when it presents
+// the frame. Fills and blits move a quarter of the bytes, and palette effects like color cycling
+// recolor the screen without touching any pixels.
+//
+
+void DrawSetPaletteMode(b32 enabled)
+{
+    if (g_state.palette_mode != enabled) g_state.palette_changed = true;
+    g_state.palette_mode = enabled;
+}
+
+void DrawSetPaletteColor(u8 index, Vector4 color)
+{
+    color.a = 1;
+    u32 value = ImageTintFromColor(color, false);
+
+    if (g_state.palette[index] != value)
+    {
+        g_state.palette[index] = value;
+        g_state.palette_changed = true;
+    }
+}
+
+void DrawSetPalette(u8 first, Vector4 *colors, i32 count)
+{
+    count = Min(count, (i32)count_of(g_state.palette) - first);
+
+    for (i32 i = 0; i < count; i += 1)
+    {
+        DrawSetPaletteColor((u8)(first + i), colors[i]);
+    }
+}
+
+Vector4 DrawGetPaletteColor(u8 index)
+{
+    return v4_rgba_from_u32(g_state.palette[index]);
+}
+
+void DrawRotatePalette(u8 first, i32 count, i32 shift)
+{
+    count = Min(count, (i32)count_of(g_state.palette) - first);
+    if (count <= 1) return;
+
+    shift %= count;
+    if (shift < 0) shift += count;
+    if (shift == 0) return;
+
+    u32 colors[256];
+    u32 *range = g_state.palette + first;
+    MemoryCopy(colors, range, count * sizeof(u32));
+
+    for (i32 i = 0; i < count; i += 1)
+    {
+        range[(i + shift) % count] = colors[i];
+    }
+
+    g_state.palette_changed = true;
+}
+
+void DrawClearIndex(u8 index)
+{
+    if (!out->indices) return;
+
+    Rectangle2i clip = g_draw.clip;
+    i32 width = clip.x1 - clip.x0;
+    if (width <= 0 || clip.y0 >= clip.y1) return;
+
+    DrawMarkDirty(clip.x0, clip.y0, clip.x1, clip.y1);
+
+    if (width == out->width)
+    {
+        MemorySet(out->indices + clip.y0 * out->width, index, (i64)(clip.y1 - clip.y0) * out->width);
+        return;
+    }
+
+    for (i32 y = clip.y0; y < clip.y1; y += 1)
+    {
+        MemorySet(out->indices + y * out->width + clip.x0, index, width);
+    }
+}
+
+void DrawSetPixelIndex(Vector2 pos, u8 index)
+{
+    if (!out->indices) return;
+
+    i32 x = (i32)pos.x;
+    i32 y = (i32)pos.y;
+
+    Rectangle2i clip = g_draw.clip;
+
+    if (x >= clip.x0 && x < clip.x1 && y >= clip.y0 && y < clip.y1)
+    {
+        DrawMarkDirty(x, y, x + 1, y + 1);
+        out->indices[y * out->width + x] = index;
+    }
+}
+
+u8 DrawGetPixelIndex(Vector2 pos)
+{
+    i32 x = (i32)pos.x;
+    i32 y = (i32)pos.y;
+
+    if (out->indices && x >= 0 && x < out->width && y >= 0 && y < out->height)
+    {
+        return out->indices[y * out->width + x];
+    }
+
+    return 0;
+}
+
+void DrawRectIndex(Rectangle2 rect, u8 index)
+{
+    if (!out->indices) return;
+
+    rect = abs_r2(rect);
+
+    Rectangle2i clip = g_draw.clip;
+
+    i32 in_x0 = Clamp((i32)rect.x0, clip.x0, clip.x1);
+    i32 in_x1 = Clamp((i32)rect.x1, clip.x0, clip.x1);
+
+    i32 in_y0 = Clamp((i32)rect.y0, clip.y0, clip.y1);
+    i32 in_y1 = Clamp((i32)rect.y1, clip.y0, clip.y1);
+
+    i32 width = in_x1 - in_x0;
+    if (width <= 0 || in_y0 >= in_y1) return;
+
+    DrawMarkDirty(in_x0, in_y0, in_x1, in_y1);
+
+    u8 *at = out->indices + in_y0 * out->width + in_x0;
+
+    for (i32 y = in_y0; y < in_y1; y += 1)
+    {
+        MemorySet(at, index, width);
+        at += out->width;
+    }
+}
+
+void DrawImageIndexed(Image_Indexed image, Vector2 pos)
+{
+    if (!out->indices || !image.indices) return;
+
+    Rectangle2i clip = g_draw.clip;
+
+    i32 x0 = (i32)pos.x;
+    i32 y0 = (i32)pos.y;
+
+    i32 in_x0 = Clamp(x0, clip.x0, clip.x1);
+    i32 in_y0 = Clamp(y0, clip.y0, clip.y1);
+
+    i32 in_x1 = Clamp(x0 + image.size.width, clip.x0, clip.x1);
+    i32 in_y1 = Clamp(y0 + image.size.height, clip.y0, clip.y1);
+
+    i32 width = in_x1 - in_x0;
+    if (width <= 0 || in_y0 >= in_y1) return;
+
+    DrawMarkDirty(in_x0, in_y0, in_x1, in_y1);
+
+    u8 *in_line = image.indices + (in_y0 - y0) * image.size.width + (in_x0 - x0);
+    u8 *out_line = out->indices + in_y0 * out->width + in_x0;
+
+    for (i32 y = in_y0; y < in_y1; y += 1)
+    {
+        simd_copy_keyed_u8(out_line, in_line, width);
+
+        in_line += image.size.width;
+        out_line += out->width;
+    }
+}
+
+// NOTE(nick): the texel at (x, y) of image, trimmed texels are transparent
+u32 ImageGetPixel(Image image, i32 x, i32 y)
+{
+    Rectangle2i trim = ImageTrim(image);
+    if (!image.pixels || x < trim.x0 || x >= trim.x1 || y < trim.y0 || y >= trim.y1) return 0;
+
+    return image.pixels[(i64)(y - trim.y0) * ImageStride(image) + (x - trim.x0)];
+}
+
+Image_Indexed ImageIndexedFromImage(Image image)
+{
+    Image_Indexed result = {0};
+
+    i64 count = (i64)image.size.width * (i64)image.size.height;
+    if (count <= 0) return result;
+
+    result.size = image.size;
+    result.indices = PushArray(g_state.arena, u8, count);
+
+    u32 last_color = 0;
+    u8 last_index = 0;
+
+    for (i32 y = 0; y < image.size.height; y += 1)
+    {
+        u8 *row = result.indices + (i64)y * image.size.width;
+
+        for (i32 x = 0; x < image.size.width; x += 1)
+        {
+            u32 it = ImageGetPixel(image, x, y);
+            i32 a = it >> 24;
+
+            if (a < 128)
+            {
+                row[x] = 0;
+                continue;
+            }
+
+            if (it == last_color && last_index)
+            {
+                row[x] = last_index;
+                continue;
+            }
+
+            // NOTE(nick): back to straight alpha
+            i32 r = Min((((it >>  0) & 0xff) * 255 + a / 2) / a, 255);
+            i32 g = Min((((it >>  8) & 0xff) * 255 + a / 2) / a, 255);
+            i32 b = Min((((it >> 16) & 0xff) * 255 + a / 2) / a, 255);
+
+            i32 best = 1;
+            i32 best_distance = I32_MAX;
+
+            for (i32 i = 1; i < count_of(g_state.palette); i += 1)
+            {
+                u32 color = g_state.palette[i];
+                i32 dr = r - (i32)((color >>  0) & 0xff);
+                i32 dg = g - (i32)((color >>  8) & 0xff);
+                i32 db = b - (i32)((color >> 16) & 0xff);
+
+                i32 distance = dr * dr + dg * dg + db * db;
+                if (distance < best_distance)
+                {
+                    best = i;
+                    best_distance = distance;
+                    if (distance == 0) break;
+                }
+            }
+
+            row[x] = (u8)best;
+            last_color = it;
+            last_index = (u8)best;
+        }
+    }
+
+    return result;
+}
+
+//
+// Sound API
+//
+
+//
+// NOTE(nick): everything is summed into a mix bus, an interleaved stereo f32 buffer in i16 units, so
+// sounds never clip against each other and there's no headroom to reserve per voice. MixerOutput is
+// the only place the bus is turned into i16: it runs the optional limiter and saturates in one pass.
+// The Play* calls write to g_state.mix_bus on the game thread, the mixer has its own.
+//
+
+void PlaySine(f32 tone_hz, u32 sample_offset, f32 volume)
+{
+    volume = clamp_f32(volume, 0, 2);
+
+    f32 wave_period = (f32)out->samples_per_second / tone_hz;
+    f32 t_sine = sample_offset * TAU / wave_period;
+    t_sine = Mod(t_sine, TAU);
+
+    f32 *sample_out = g_state.mix_bus;
+    for (int sample_index = 0; sample_index < out->sample_count; sample_index++)
+    {
+        f32 sine_value   = sin_f32(t_sine);
+        f32 sample_value = sine_value * volume * I16_MAX;
+        *sample_out++ += sample_value;
+        *sample_out++ += sample_value;
+
+        t_sine += TAU / (f32)wave_period;
+        if (t_sine >= TAU) {
+            t_sine -= TAU;
+        }
+    }
+}
+
+void PlaySquare(f32 tone_hz, u32 sample_offset, f32 volume)
+{
+    volume = clamp_f32(volume, 0, 2);
+
+    f32 wave_period = (f32)out->samples_per_second / tone_hz;
+    f32 t_sine = sample_offset * TAU / wave_period;
+    t_sine = Mod(t_sine, TAU);
+
+    f32 *sample_out = g_state.mix_bus;
+    for (int sample_index = 0; sample_index < out->sample_count; sample_index++)
+    {
+        f32 sine_value   = t_sine <= PI ? 1.0 : -1.0;
+        f32 sample_value = sine_value * volume * I16_MAX;
+        *sample_out++ += sample_value;
+        *sample_out++ += sample_value;
+
+        t_sine += TAU / (f32)wave_period;
+        if (t_sine >= TAU) {
+            t_sine -= TAU;
+        }
+    }
+}
+
+void PlayTriangle(f32 tone_hz, u32 sample_offset, f32 volume)
+{
+    volume = clamp_f32(volume, 0, 2);
+
+    f32 wave_period = (f32)out->samples_per_second / tone_hz;
+    f32 t_sine = sample_offset * TAU / (f32)wave_period;
+    t_sine = Mod(t_sine, TAU);
+
+    f32 *sample_out = g_state.mix_bus;
+    for (i32 sample_index = 0; sample_index < out->sample_count; sample_index++)
+    {
+        f32 triangle_value   = 1.0 - 2.0 * abs_f32(t_sine / PI - 1.0);
+
+        f32 sample_value = triangle_value * volume * I16_MAX;
+        *sample_out++ += sample_value;
+        *sample_out++ += sample_value;
+
+        t_sine += TAU / (f32)wave_period;
+        if (t_sine >= TAU) {
+            t_sine -= TAU;
+        }
+    }
+}
+
+void PlaySawtooth(f32 tone_hz, u32 sample_offset, f32 volume)
+{
+    volume = clamp_f32(volume, 0, 2);
+
+    f32 wave_period = (f32)out->samples_per_second / tone_hz;
+    f32 t_sine = sample_offset * TAU / (f32)wave_period;
+    t_sine = Mod(t_sine, TAU);
+
+    f32 *sample_out = g_state.mix_bus;
+    for (int sample_index = 0; sample_index < out->sample_count; sample_index++)
+    {
+        f32 sawtooth_value   = t_sine / PI - 1.0;
+        f32 sample_value = sawtooth_value * volume * I16_MAX;
+        *sample_out++ += sample_value;
+        *sample_out++ += sample_value;
+
+        t_sine += TAU / (f32)wave_period;
+        if (t_sine >= TAU) {
+            t_sine -= TAU;
+        }
+    }
+}
+
+void PlayNoise(f32 volume)
+{
+    volume = clamp_f32(volume, 0, 2);
 
-        if (!asset)
-        {
-            print("[LoadFont] Used all %d slots available! Failed to load font: %.*s\n", count_of(g_state.fonts), LIT(path));
-        }
-    }
+    Random_PCG *rng = &g_state.rng;
 
-    if (asset)
+    f32 *sample_out = g_state.mix_bus;
+    for (int sample_index = 0; sample_index < out->sample_count; sample_index++)
     {
-        if (asset->info.hash == 0)
-        {
-            Image image = LoadImage(path);
-            if (image.size.x > 0 && image.size.y > 0)
-            {
-                asset->font = FontMakeFromImageMono(image, alphabet, monospaced_letter_size);
-                asset->info.name = path;
-                asset->info.hash = hash;
-            }
-        }
-
-        result = asset->font;
+        f32 random_value = random_pcg_between_f32(rng, -1.0, 1.0);
+        f32 sample_value = random_value * volume * I16_MAX;
+        *sample_out++ += sample_value;
+        *sample_out++ += sample_value;
     }
-
-    return result;
 }
 
-Font LoadFontExt(String path, Font_Glyph *glyphs, u64 glyph_count)
+function u32 SoundMix(f32 *bus, i64 frame_count, Sound sound, u32 sample_offset, f32 volume)
 {
-    Image image = LoadImage(path);
-    return FontMake(image, glyphs, glyph_count);
-}
+    i16 *at = (i16 *)((u8 *)sound.samples + sample_offset * sizeof(i16) * 2);
 
-//
-// Controller API
-//
+    u32 samples_remaining = sound.total_samples - sample_offset;
 
-b32 ControllerPressed(int index, Controller_Button button)
-{
-    b32 result = false;
-    if (index >= 0 && index < count_of(input->controllers))
-    {
-        if (button >= 0 && button < Button_COUNT)
-        {
-            b32 *prev_state = (b32 *)&prev_input->controllers[index];
-            b32 *state = (b32 *)&input->controllers[index];
+    u32 sample_count = (u32)Min(frame_count, samples_remaining);
 
-            result = !prev_state[button] && state[button];
-        }
-    }
-    return result;
+    simd_mix_i16(bus, at, (i64)sample_count * 2, volume);
+
+    return sample_count;
 }
 
-b32 ControllerDown(int index, Controller_Button button)
+u32 PlaySoundStream(Sound sound, u32 sample_offset, f32 volume)
 {
-    b32 result = false;
-    if (index >= 0 && index < count_of(input->controllers))
-    {
-        if (button >= 0 && button < Button_COUNT)
-        {
-            b32 *prev_state = (b32 *)&prev_input->controllers[index];
-            b32 *state = (b32 *)&input->controllers[index];
+    Sound_Asset *asset = (Sound_Asset *)GetAssetByIndex(&g_state.sounds, sizeof(Sound_Asset), count_of(g_state.sounds), sound.index); 
+    if (!asset) return 0;
 
-            result = state[button];
-        }
-    }
-    return result;
+    volume = clamp_f32(volume, 0, 2);
+
+    return SoundMix(g_state.mix_bus, out->sample_count, sound, sample_offset, volume);
 }
 
-b32 ControllerReleased(int index, Controller_Button button)
+// NOTE(nick): game thread only, commands are dropped when the queue is full
+function b32 MixerPushCommand(Mix_Command command)
 {
-    b32 result = false;
-    if (index >= 0 && index < count_of(input->controllers))
-    {
-        if (button >= 0 && button < Button_COUNT)
-        {
-            b32 *prev_state = (b32 *)&prev_input->controllers[index];
-            b32 *state = (b32 *)&input->controllers[index];
+    Mixer *mixer = &g_state.mixer;
 
-            result = prev_state[button] && !state[button];
-        }
-    }
-    return result;
+    // NOTE(nick): na.h only has read-modify-write atomics, adding 0 is the barriered load
+    u64 read_index = atomic_add_u64(&mixer->command_read_index, 0);
+    u64 write_index = mixer->command_write_index;
+
+    if (write_index - read_index >= MIX_COMMAND_QUEUE_SIZE) return false;
+
+    mixer->commands[write_index & (MIX_COMMAND_QUEUE_SIZE - 1)] = command;
+    atomic_exchange_u64(&mixer->command_write_index, write_index + 1);
+
+    return true;
 }
 
-Vector2 MousePosition()
+void MixerPlaySound(Sound sound, f32 volume)
 {
-    return input->mouse.position;
+    Sound_Asset *asset = (Sound_Asset *)GetAssetByIndex(&g_state.sounds, sizeof(Sound_Asset), count_of(g_state.sounds), sound.index); 
+    if (!asset) return;
+
+    Mix_Command command = {0};
+    command.type = MixCommand_PlaySound;
+    command.sound = sound;
+    command.value = volume;
+    MixerPushCommand(command);
 }
 
-b32 MousePressed(Mouse_Button button)
+void MixerSetMasterVolume(f32 master_volume)
 {
-    b32 result = false;
-    if (button >= 0 && button < Mouse_COUNT)
-    {
-        b32 *prev_state = (b32 *)&prev_input->mouse;
-        b32 *state = (b32 *)&input->mouse;
-        result = !prev_state[button] && state[button];
-    }
-    return result;
+    Mix_Command command = {0};
+    command.type = MixCommand_SetMasterVolume;
+    command.value = Clamp(master_volume, 0.0, 1.0);
+    MixerPushCommand(command);
 }
 
-b32 MouseDown(Mouse_Button button)
+void MixerSetLimiter(b32 enabled)
 {
-    b32 result = false;
-    if (button >= 0 && button < Mouse_COUNT)
-    {
-        b32 *prev_state = (b32 *)&prev_input->mouse;
-        b32 *state = (b32 *)&input->mouse;
-        result = state[button];
-    }
-    return result;
+    Mix_Command command = {0};
+    command.type = MixCommand_SetLimiter;
+    command.value = enabled ? 1 : 0;
+    MixerPushCommand(command);
 }
 
-b32 MouseReleased(Mouse_Button button)
+void MixerOutputPlayingSounds()
 {
-    b32 result = false;
-    if (button >= 0 && button < Mouse_COUNT)
-    {
-        b32 *prev_state = (b32 *)&prev_input->mouse;
-        b32 *state = (b32 *)&input->mouse;
-        result = prev_state[button] && !state[button];
-    }
-    return result;
 }
 
 //
-// Drawing API
+// NOTE(nick): voice bank
+//
+// Voices are mono and go to both channels of the mix bus. They're rendered in blocks of
+// MIX_VOICE_BLOCK_SIZE frames, LANE_WIDTH voices at a time: the table reads are scalar but the
+// interpolation, the gain ramp and the sum across voices are done in lanes. The square, triangle and
+// sawtooth tables are additive so they don't alias, with one table per octave.
 //
 
-void DrawSetPixel(Vector2 pos, Vector4 color)
+function void WavetablesBuild()
 {
-    i32 x = (i32)pos.x;
-    i32 y = (i32)pos.y;
+    Arena *arena = g_state.arena;
 
-    if (x >= 0 && x < out->width && y >= 0 && y < out->height)
+    f32 *sine = PushArray(arena, f32, WAVETABLE_SIZE + 1);
+    for (i32 i = 0; i <= WAVETABLE_SIZE; i += 1)
     {
-        u32 out_color = u32_rgba_from_v4(color);
-        u32 *at = &out->pixels[y * out->width + x];
-        *at = out_color;
+        sine[i] = (f32)sin(TAU * (f64)i / WAVETABLE_SIZE);
     }
-}
-
-u32 DrawGetPixel(Vector2 pos)
-{
-    u32 result = 0;
-
-    i32 x = (i32)pos.x;
-    i32 y = (i32)pos.y;
 
-    if (x >= 0 && x < out->width && y >= 0 && y < out->height)
+    for (i32 octave = 0; octave < WAVETABLE_OCTAVE_COUNT; octave += 1)
     {
-        u32 *at = &out->pixels[y * out->width + x];
-        result = *at;
+        g_state.wavetables[Waveform_Sine][octave] = sine;
     }
 
-    return result;
-}
-
-typedef u32 OutCode;
-enum
-{
-    OutCode_LEFT   = 1,
-    OutCode_RIGHT  = 2,
-    OutCode_BOTTOM = 4,
-    OutCode_TOP    = 8,
-};
-
-OutCode computeOutCode(i32 x, i32 y, i32 max_x, i32 max_y)
-{
-    int code = 0;
-    if (x < 0) code |= OutCode_LEFT;
-    else if (x > max_x) code |= OutCode_RIGHT;
-    if (y < 0) code |= OutCode_BOTTOM;
-    else if (y > max_y) code |= OutCode_TOP;
-    return code;
-}
+    for (Waveform waveform = Waveform_Square; waveform <= Waveform_Sawtooth; waveform += 1)
+    {
+        for (i32 octave = 0; octave < WAVETABLE_OCTAVE_COUNT; octave += 1)
+        {
+            f64 top_hz = (f64)(WAVETABLE_BASE_HZ << (octave + 1));
+            i32 harmonic_count = Clamp((i32)((WAVETABLE_SAMPLE_RATE / 2) / top_hz), 1, WAVETABLE_SIZE / 2);
 
-b32 cohenSutherlandClip(i32 *in_x0, i32 *in_y0, i32 *in_x1, i32 *in_y1, i32 max_x, i32 max_y) {
-    i32 x0 = *in_x0;
-    i32 y0 = *in_y0;
-    i32 x1 = *in_x1;
-    i32 y1 = *in_y1;
+            f32 *table = PushArray(arena, f32, WAVETABLE_SIZE + 1);
+            f32 peak = 0;
 
-    int outcode0 = computeOutCode(x0, y0, max_x, max_y);
-    int outcode1 = computeOutCode(x1, y1, max_x, max_y);
-    b32 accept = 0;
+            for (i32 i = 0; i < WAVETABLE_SIZE; i += 1)
+            {
+                // NOTE(nick): sin(h x) and cos(h x) by the recurrence f(h + 1) = 2 cos(x) f(h) - f(h - 1)
+                f64 x = TAU * (f64)i / WAVETABLE_SIZE;
+                f64 k = 2 * cos(x);
+                f64 s0 = 0, s1 = sin(x);
+                f64 c0 = 1, c1 = cos(x);
+
+                f64 sum = 0;
+                for (i32 h = 1; h <= harmonic_count; h += 1)
+                {
+                    // NOTE(nick): the series match the shapes PlaySquare, PlayTriangle and PlaySawtooth draw
+                    if (waveform == Waveform_Square)
+                    {
+                        if (h & 1) sum += s1 * (4 / (PI * h));
+                    }
+                    else if (waveform == Waveform_Triangle)
+                    {
+                        if (h & 1) sum -= c1 * (8 / (PI * PI * h * h));
+                    }
+                    else
+                    {
+                        sum -= s1 * (2 / (PI * h));
+                    }
+
+                    f64 s2 = k * s1 - s0; s0 = s1; s1 = s2;
+                    f64 c2 = k * c1 - c0; c0 = c1; c1 = c2;
+                }
 
-    while (1) {
-        if (!(outcode0 | outcode1)) {
-            // Both endpoints are inside the rectangle
-            accept = 1;
-            break;
-        } else if (outcode0 & outcode1) {
-            // Both endpoints share an outside zone (logical AND is not 0)
-            break;
-        } else {
-            // At least one endpoint is outside the rectangle
-            int outcodeOut = outcode0 ? outcode0 : outcode1;
-            int x, y;
-
-            if (outcodeOut & OutCode_TOP) {           // Point is above the rectangle
-                x = x0 + (x1 - x0) * (max_y - y0) / (y1 - y0);
-                y = max_y;
-            } else if (outcodeOut & OutCode_BOTTOM) { // Point is below the rectangle
-                x = x0 + (x1 - x0) * (0 - y0) / (y1 - y0);
-                y = 0;
-            } else if (outcodeOut & OutCode_RIGHT) {  // Point is to the right of the rectangle
-                y = y0 + (y1 - y0) * (max_x - x0) / (x1 - x0);
-                x = max_x;
-            } else if (outcodeOut & OutCode_LEFT) {   // Point is to the left of the rectangle
-                y = y0 + (y1 - y0) * (0 - x0) / (x1 - x0);
-                x = 0;
+                table[i] = (f32)sum;
+                peak = Max(peak, abs_f32(table[i]));
             }
 
-            if (outcodeOut == outcode0) {
-                x0 = x;
-                y0 = y;
-                outcode0 = computeOutCode(x0, y0, max_x, max_y);
-            } else {
-                x1 = x;
-                y1 = y;
-                outcode1 = computeOutCode(x1, y1, max_x, max_y);
+            // NOTE(nick): band limiting overshoots the edges, keep every octave at the same peak
+            for (i32 i = 0; i < WAVETABLE_SIZE; i += 1)
+            {
+                table[i] /= peak;
             }
+            table[WAVETABLE_SIZE] = table[0];
+
+            g_state.wavetables[waveform][octave] = table;
         }
     }
 
-    *in_x0 = x0;
-    *in_y0 = y0;
-    *in_x1 = x1;
-    *in_y1 = y1;
+    i32 noise_size = 1 << NOISE_TABLE_BITS;
+    f32 *noise = PushArray(arena, f32, noise_size + 1);
+    for (i32 i = 0; i < noise_size; i += 1)
+    {
+        noise[i] = random_pcg_between_f32(&g_state.rng, -1.0, 1.0);
+    }
+    noise[noise_size] = noise[0];
 
-    return accept;
+    for (i32 octave = 0; octave < WAVETABLE_OCTAVE_COUNT; octave += 1)
+    {
+        g_state.wavetables[Waveform_Noise][octave] = noise;
+    }
 }
 
-void DrawRect(Rectangle2 rect, Vector4 color)
+Voice VoiceStartExt(Waveform waveform, f32 tone_hz, f32 volume, Envelope envelope)
 {
-    // TimeFunction;
-
-    rect = abs_r2(rect);
-
-    i32 in_x0 = Clamp((i32)rect.x0, 0, out->width);
-    i32 in_x1 = Clamp((i32)rect.x1, 0, out->width);
-
-    i32 in_y0 = Clamp((i32)rect.y0, 0, out->height);
-    i32 in_y1 = Clamp((i32)rect.y1, 0, out->height);
-
-    u32 out_color = u32_rgba_from_v4(color);
+    Mixer *mixer = &g_state.mixer;
 
-    u32 *at = &out->pixels[in_y0 * out->width + in_x0];
-
-    for (i32 y = in_y0; y < in_y1; y += 1)
+    // NOTE(nick): a free voice if there is one, otherwise the quietest. The mixer publishes the
+    // gains once per block so they can be a little behind, that's fine for picking one to take over.
+    i32 index = 0;
+    f32 quietest = F32_MAX;
+    for (i32 i = 0; i < MIX_VOICE_COUNT; i += 1)
     {
-        for (i32 x = in_x0; x < in_x1; x += 1)
+        if (mixer->voice_done[i] == g_state.voice_generations[i]) { index = i; break; }
+
+        f32 gain = mixer->voice_gain[i];
+        if (gain < quietest)
         {
-            //pixels[y * out->width + x] = out_color;
-            *at = out_color;
-            at += 1;
+            index = i;
+            quietest = gain;
         }
-
-        at += out->width - (in_x1 - in_x0);
     }
-}
-
-/*
-c0 ----- c1
-|        |
-|        |
-|        |
-c2 ----- c3
-*/
-void DrawRectExt(Rectangle2 rect, Vector4 c0, Vector4 c1, Vector4 c2, Vector4 c3)
-{
-    rect = abs_r2(rect);
 
-    i32 in_x0 = Clamp((i32)rect.x0, 0, out->width);
-    i32 in_x1 = Clamp((i32)rect.x1, 0, out->width);
+    u32 generation = g_state.voice_generations[index] + 1;
+    if (generation == 0) generation = 1;
 
-    i32 in_y0 = Clamp((i32)rect.y0, 0, out->height);
-    i32 in_y1 = Clamp((i32)rect.y1, 0, out->height);
+    Voice result = {0};
+    result.index = index;
+    result.generation = generation;
 
-    u32 *at = &out->pixels[in_y0 * out->width + in_x0];
+    Mix_Command command = {0};
+    command.type = MixCommand_VoiceStart;
+    command.voice = result;
+    command.waveform = Clamp(waveform, 0, Waveform_COUNT - 1);
+    command.tone_hz = tone_hz;
+    command.value = clamp_f32(volume, 0, 2);
+    command.envelope = envelope;
+    command.envelope.sustain = clamp_01_f32(envelope.sustain);
 
-    for (i32 y = in_y0; y < in_y1; y += 1)
+    if (!MixerPushCommand(command))
     {
-        for (i32 x = in_x0; x < in_x1; x += 1)
-        {
-            f32 u = (x - in_x0) / (f32)(in_x1 - in_x0);
-            f32 v = (y - in_y0) / (f32)(in_y1 - in_y0);
-
-            Vector4 sample = lerp_v4(lerp_v4(c0, c2, v), lerp_v4(c1, c3, v), u);
+        Voice none = {0};
+        return none;
+    }
 
-            u32 sample_color = u32_rgba_from_v4(sample);
+    g_state.voice_generations[index] = generation;
+    return result;
+}
 
-            *at = sample_color;
-            at += 1;
-        }
+Voice VoiceStart(Waveform waveform, f32 tone_hz, f32 volume)
+{
+    // NOTE(nick): just long enough to not click
+    Envelope envelope = {0};
+    envelope.attack = 0.005;
+    envelope.sustain = 1.0;
+    envelope.release = 0.005;
 
-        at += out->width - (in_x1 - in_x0);
-    }
+    return VoiceStartExt(waveform, tone_hz, volume, envelope);
 }
 
-void DrawRectOutline(Rectangle2 rect, Vector4 color, int thickness)
+b32 VoiceIsPlaying(Voice voice)
 {
-    i32 in_x0 = Clamp((i32)rect.x0, 0, out->width);
-    i32 in_y0 = Clamp((i32)rect.y0, 0, out->height);
-    i32 in_x1 = Clamp((i32)rect.x1, 0, out->width);
-    i32 in_y1 = Clamp((i32)rect.y1, 0, out->height);
+    if (voice.index >= MIX_VOICE_COUNT || voice.generation == 0) return false;
 
-    // top
-    DrawRect(r2_from_f32(in_x0, in_y0, in_x1, in_y0+thickness), color);
+    return g_state.voice_generations[voice.index] == voice.generation &&
+        g_state.mixer.voice_done[voice.index] != voice.generation;
+}
 
-    // bottom
-    DrawRect(r2_from_f32(in_x0, in_y1, in_x1, in_y1-thickness), color);
+function void VoicePushCommand(Mix_Command_Type type, Voice voice, f32 value)
+{
+    if (!VoiceIsPlaying(voice)) return;
 
-    // left
-    DrawRect(r2_from_f32(in_x0, in_y0, in_x0+thickness, in_y1), color);
+    Mix_Command command = {0};
+    command.type = type;
+    command.voice = voice;
+    command.value = value;
+    MixerPushCommand(command);
+}
 
-    // right
-    DrawRect(r2_from_f32(in_x1, in_y0, in_x1-thickness, in_y1), color);
+void VoiceStop(Voice voice)
+{
+    VoicePushCommand(MixCommand_VoiceStop, voice, 0);
 }
 
-void DrawCircle(Vector2 pos, f32 radius, Vector4 color)
+void VoiceSetTone(Voice voice, f32 tone_hz)
 {
-    i32 in_x0 = Clamp((i32)pos.x - radius, 0, out->width);
-    i32 in_x1 = Clamp((i32)pos.x + radius, 0, out->width);
+    VoicePushCommand(MixCommand_VoiceSetTone, voice, tone_hz);
+}
 
-    i32 in_y0 = Clamp((i32)pos.y - radius, 0, out->height);
-    i32 in_y1 = Clamp((i32)pos.y + radius, 0, out->height);
+void VoiceSetVolume(Voice voice, f32 volume)
+{
+    VoicePushCommand(MixCommand_VoiceSetVolume, voice, clamp_f32(volume, 0, 2));
+}
 
-    u32 out_color = u32_rgba_from_v4(color);
-    u32 *at = &out->pixels[in_y0 * out->width + in_x0];
+function void VoiceEnvelopeAdvance(Mix_Voice *it, f32 dt)
+{
+    Envelope *env = &it->envelope;
 
-    for (i32 y = in_y0; y < in_y1; y += 1)
+    while (dt > 0 && it->stage != Envelope_Off)
     {
-        for (i32 x = in_x0; x < in_x1; x += 1)
+        if (it->stage == Envelope_Attack)
         {
-            f32 cx = 2 * ((x - in_x0) / (f32)(in_x1 - in_x0)) - 1;
-            f32 cy = 2 * ((y - in_y0) / (f32)(in_y1 - in_y0)) - 1;
+            f32 rate = env->attack > 0 ? 1 / env->attack : F32_MAX;
+            f32 t = (1 - it->level) / rate;
+            if (t > dt) { it->level += rate * dt; break; }
 
-            if (cx * cx + cy * cy < 1)
-            {
-                *at = out_color;
-            }
+            dt -= t;
+            it->level = 1;
+            it->stage = Envelope_Decay;
+        }
+        else if (it->stage == Envelope_Decay)
+        {
+            f32 rate = env->decay > 0 ? (1 - env->sustain) / env->decay : F32_MAX;
+            f32 t = rate > 0 ? (it->level - env->sustain) / rate : 0;
+            if (t > dt) { it->level -= rate * dt; break; }
 
-            //pixels[y * out->width + x] = out_color;
-            at += 1;
+            dt -= t;
+            it->level = env->sustain;
+            it->stage = Envelope_Sustain;
+        }
+        else if (it->stage == Envelope_Sustain)
+        {
+            break;
         }
+        else if (it->stage == Envelope_Release)
+        {
+            f32 t = it->release_rate > 0 ? it->level / it->release_rate : 0;
+            if (t > dt) { it->level -= it->release_rate * dt; break; }
 
-        at += out->width - (in_x1 - in_x0);
+            it->level = 0;
+            it->stage = Envelope_Off;
+        }
     }
 }
 
-void DrawTriangle(Vector2 p0, Vector2 p1, Vector2 p2, Vector4 color)
+function void VoiceBankRender(Mixer *mixer, f32 *bus, i64 frame_count, i32 samples_per_second)
 {
-    f32 min_x = min_f32(p0.x, min_f32(p1.x, p2.x));
-    f32 max_x = max_f32(p0.x, max_f32(p1.x, p2.x));
+    i32 voice_indices[MIX_VOICE_COUNT];
+    i32 voice_count = 0;
 
-    f32 min_y = min_f32(p0.y, min_f32(p1.y, p2.y));
-    f32 max_y = max_f32(p0.y, max_f32(p1.y, p2.y));
+    for (i32 i = 0; i < MIX_VOICE_COUNT; i += 1)
+    {
+        if (mixer->voices[i].active) voice_indices[voice_count++] = i;
+    }
 
-    Rectangle2 rect = r2(v2(min_x, min_y), v2(max_x, max_y));
+    if (voice_count == 0 || samples_per_second <= 0) return;
 
-    i32 in_x0 = Clamp((i32)rect.x0, 0, out->width);
-    i32 in_x1 = Clamp((i32)rect.x1, 0, out->width);
+    // NOTE(nick): phase steps and octaves are worked out every frame so retuning is just a store
+    f32 *tables[MIX_VOICE_COUNT];
+    u32 steps[MIX_VOICE_COUNT];
+    u32 shifts[MIX_VOICE_COUNT];
 
-    i32 in_y0 = Clamp((i32)rect.y0, 0, out->height);
-    i32 in_y1 = Clamp((i32)rect.y1, 0, out->height);
+    for (i32 i = 0; i < voice_count; i += 1)
+    {
+        Mix_Voice *it = &mixer->voices[voice_indices[i]];
 
-    u32 out_color = u32_rgba_from_v4(color);
+        f64 tone_hz = Clamp(it->tone_hz, 0, samples_per_second * 0.5);
+        f64 cycles_per_sample = tone_hz / samples_per_second;
 
-    u32 *at = &out->pixels[in_y0 * out->width + in_x0];
+        i32 table_bits = WAVETABLE_BITS;
+        i32 octave = 0;
 
-    for (i32 y = in_y0; y < in_y1; y += 1)
-    {
-        for (i32 x = in_x0; x < in_x1; x += 1)
+        if (it->waveform == Waveform_Noise)
+        {
+            table_bits = NOISE_TABLE_BITS;
+            cycles_per_sample /= (f64)(1 << NOISE_TABLE_BITS);
+        }
+        else
         {
-            if (point_in_triangle(v2(x, y), p0, p1, p2))
+            while (octave < WAVETABLE_OCTAVE_COUNT - 1 && tone_hz > (WAVETABLE_BASE_HZ << (octave + 1)))
             {
-                *at = out_color;
+                octave += 1;
             }
-            //pixels[y * out->width + x] = out_color;
-            at += 1;
         }
 
-        at += out->width - (in_x1 - in_x0);
+        tables[i] = g_state.wavetables[it->waveform][octave];
+        steps[i] = (u32)(cycles_per_sample * 4294967296.0);
+        shifts[i] = 32 - table_bits;
     }
-}
 
-void DrawTriangleExt(Vector2 p0, Vector4 c0, Vector2 p1, Vector4 c1, Vector2 p2, Vector4 c2)
-{
-    f32 min_x = min_f32(p0.x, min_f32(p1.x, p2.x));
-    f32 max_x = max_f32(p0.x, max_f32(p1.x, p2.x));
+    Lane_F32 acc[MIX_VOICE_BLOCK_SIZE];
 
-    f32 min_y = min_f32(p0.y, min_f32(p1.y, p2.y));
-    f32 max_y = max_f32(p0.y, max_f32(p1.y, p2.y));
+    for (i64 block = 0; block < frame_count; block += MIX_VOICE_BLOCK_SIZE)
+    {
+        i32 block_size = (i32)Min(frame_count - block, MIX_VOICE_BLOCK_SIZE);
+        f32 dt = (f32)block_size / samples_per_second;
 
-    Rectangle2 rect = r2(v2(min_x, min_y), v2(max_x, max_y));
+        for (i32 i = 0; i < block_size; i += 1)
+        {
+            acc[i] = lane_f32_set1(0);
+        }
 
-    i32 in_x0 = Clamp((i32)rect.x0, 0, out->width);
-    i32 in_x1 = Clamp((i32)rect.x1, 0, out->width);
+        for (i32 group = 0; group < voice_count; group += LANE_WIDTH)
+        {
+            // NOTE(nick): lanes past the last voice read the start of the sine table at zero gain
+            Mix_Voice *voices[LANE_WIDTH] = {0};
+            f32 *table[LANE_WIDTH];
+            u32 phase[LANE_WIDTH], step[LANE_WIDTH], shift[LANE_WIDTH];
+            f32 gain[LANE_WIDTH], gain_step[LANE_WIDTH];
 
-    i32 in_y0 = Clamp((i32)rect.y0, 0, out->height);
-    i32 in_y1 = Clamp((i32)rect.y1, 0, out->height);
+            for (i32 l = 0; l < LANE_WIDTH; l += 1)
+            {
+                i32 i = group + l;
 
-    Vector2 center = r2_center(rect);
+                table[l] = g_state.wavetables[Waveform_Sine][0];
+                phase[l] = 0;
+                step[l] = 0;
+                shift[l] = 32 - WAVETABLE_BITS;
+                gain[l] = 0;
+                gain_step[l] = 0;
 
-    u32 *at = &out->pixels[in_y0 * out->width + in_x0];
+                if (i >= voice_count) continue;
 
-    for (i32 y = in_y0; y < in_y1; y += 1)
-    {
-        for (i32 x = in_x0; x < in_x1; x += 1)
-        {
-            Vector2 point = v2(x, y);
-            if (point_in_triangle(point, p0, p1, p2))
+                Mix_Voice *it = &mixer->voices[voice_indices[i]];
+                voices[l] = it;
+
+                VoiceEnvelopeAdvance(it, dt);
+                f32 target = it->volume * it->level;
+
+                table[l] = tables[i];
+                phase[l] = it->phase;
+                step[l] = steps[i];
+                shift[l] = shifts[i];
+                // NOTE(nick): the bus is in i16 units
+                gain[l] = it->gain * I16_MAX;
+                gain_step[l] = (target - it->gain) * I16_MAX / block_size;
+
+                it->gain = target;
+            }
+
+            Lane_F32 lane_gain = lane_f32_load(gain);
+            Lane_F32 lane_gain_step = lane_f32_load(gain_step);
+
+            for (i32 i = 0; i < block_size; i += 1)
+            {
+                f32 a[LANE_WIDTH], b[LANE_WIDTH], t[LANE_WIDTH];
+
+                for (i32 l = 0; l < LANE_WIDTH; l += 1)
+                {
+                    u32 p = phase[l];
+                    u32 index = p >> shift[l];
+
+                    a[l] = table[l][index];
+                    b[l] = table[l][index + 1];
+                    // NOTE(nick): the bits under the index, as a fraction in 0..1 with 24 bits kept
+                    t[l] = (f32)((p << (32 - shift[l])) >> 8) * (1.0f / 16777216.0f);
+
+                    phase[l] = p + step[l];
+                }
+
+                Lane_F32 lane_a = lane_f32_load(a);
+                Lane_F32 sample = lane_a + (lane_f32_load(b) - lane_a) * lane_f32_load(t);
+
+                acc[i] += sample * lane_gain;
+                lane_gain += lane_gain_step;
+            }
+
+            for (i32 l = 0; l < LANE_WIDTH; l += 1)
             {
-                // barycentric coordinates
-                Vector2 v0 = p1 - p0;
-                Vector2 v1 = p2 - p0;
-                Vector2 v2 = point - p0;
-                f32 d00 = v2_dot(v0, v0);
-                f32 d01 = v2_dot(v0, v1);
-                f32 d11 = v2_dot(v1, v1);
-                f32 d20 = v2_dot(v2, v0);
-                f32 d21 = v2_dot(v2, v1);
-                f32 denom = d00 * d11 - d01 * d01;
-
-                f32 v = (d11 * d20 - d01 * d21) / denom;
-                f32 w = (d00 * d21 - d01 * d20) / denom;
-                f32 u = 1.0f - v - w;
-
-                Vector4 sample = c0 * u + c1 * v + c2 * w;
-                u32 sample_color = u32_rgba_from_v4(sample);
-
-                *at = sample_color;
+                if (voices[l]) voices[l]->phase = phase[l];
             }
-            
-            at += 1;
         }
 
-        at += out->width - (in_x1 - in_x0);
-    }
-}
+        f32 *dest = bus + block * 2;
+        for (i32 i = 0; i < block_size; i += 1)
+        {
+            f32 sum[LANE_WIDTH];
+            lane_f32_store(sum, acc[i]);
 
-void DrawLine(Vector2 p0, Vector2 p1, Vector4 color)
-{
-    i32 x0 = (i32)p0.x;
-    i32 y0 = (i32)p0.y;
-    i32 x1 = (i32)p1.x;
-    i32 y1 = (i32)p1.y;
-    cohenSutherlandClip(&x0, &y0, &x1, &y1, out->width, out->height);
+            f32 value = 0;
+            for (i32 l = 0; l < LANE_WIDTH; l += 1) value += sum[l];
 
-    int dx = abs(x1 - x0);
-    int dy = abs(y1 - y0);
-    int sx = (x0 < x1) ? 1 : -1;
-    int sy = (y0 < y1) ? 1 : -1;
-    int err = dx - dy;
+            dest[2 * i + 0] += value;
+            dest[2 * i + 1] += value;
+        }
+    }
 
-    while (1)
+    for (i32 i = 0; i < voice_count; i += 1)
     {
-        DrawSetPixel(v2(x0, y0), color);
+        i32 index = voice_indices[i];
+        Mix_Voice *it = &mixer->voices[index];
 
-        if (x0 == x1 && y0 == y1) break;
+        mixer->voice_gain[index] = it->gain;
 
-        int e2 = 2 * err;
-        if (e2 > -dy) {
-            err -= dy;
-            x0 += sx;
-        }
-        if (e2 < dx) {
-            err += dx;
-            y0 += sy;
+        if (it->stage == Envelope_Off)
+        {
+            it->active = false;
+            mixer->voice_done[index] = it->generation;
         }
     }
 }
 
-void DrawImage(Image image, Vector2 pos)
-{
-    u32 *pixels = (u32 *)out->pixels;
-
-    Rectangle2 rect = r2(pos, pos + v2_from_v2i(image.size));
-    rect = abs_r2(rect);
-
-    i32 in_x0 = Clamp((i32)rect.x0, 0, out->width);
-    i32 in_y0 = Clamp((i32)rect.y0, 0, out->height);
-
-    i32 in_x1 = Clamp((i32)rect.x1, 0, out->width);
-    i32 in_y1 = Clamp((i32)rect.y1, 0, out->height);
-
-    if (in_x0 == in_x1 || in_y0 == in_y1) return;
-    if (image.size.width == 0 || image.size.height == 0) return;
-
-    u32 *samples = image.pixels;
-    u32 *at = &pixels[in_y0 * out->width + in_x0];
-
-    i32 height = in_y1 - in_y0;
-    i32 width = in_x1 - in_x0;
+//
+// Music
+//
 
-    i32 src_pos_x = in_x0 - (i32)rect.x0;
-    i32 src_pos_y = in_y0 - (i32)rect.y0;
+function Music_Stream *MusicFromHandle(Music music)
+{
+    if (music.index <= 0 || music.index > MUSIC_SLOT_COUNT) return NULL;
 
-    u8 *in_data = (u8 *)image.pixels;
-    u32 in_pitch = sizeof(u32) * image.size.width;
-    u8 *in_line = in_data + (src_pos_y * in_pitch) + (sizeof(u32) * src_pos_x);
+    Music_Stream *stream = &g_state.music[music.index - 1];
+    return stream->open ? stream : NULL;
+}
 
-    u8 *out_data = (u8 *)out->pixels;
-    u32 out_pitch = sizeof(u32) * out->width;
-    u8 *out_line = out_data + (in_y0 * out_pitch) + (sizeof(u32) * in_x0);
+function void MusicDecodeBuffer(Music_Stream *stream, u32 b, b32 rewind)
+{
+    if (rewind)
+    {
+        drwav_seek_to_pcm_frame(&stream->wav, 0);
+        stream->at_end = false;
+    }
 
-    u32 in_copy_size = sizeof(u32) * width;
+    i16 *dest = stream->buffers[b];
+    u64 frame_count = 0;
+    b32 is_last = false;
 
-    for (i32 y = 0; y < height; y += 1)
+    while (frame_count < MUSIC_WINDOW_FRAMES)
     {
-        u32 *in_pixel = (u32 *)in_line;
-        u32 *out_pixel = (u32 *)out_line;
+        u64 read_count = drwav_read_pcm_frames_s16(&stream->wav, MUSIC_WINDOW_FRAMES - frame_count, dest + frame_count * 2);
+        frame_count += read_count;
+        if (frame_count == MUSIC_WINDOW_FRAMES) break;
 
-        for (int x = 0; x < width; x += 1)
+        // NOTE(nick): hit the end of the file, nothing read right after a rewind means it never will
+        if (stream->looping && !(rewind && read_count == 0))
         {
-            u32 sample_color = *in_pixel;
-            if ((sample_color & 0xff000000) != 0)
-            {
-                *out_pixel = sample_color;
-            }
-
-            in_pixel += 1;
-            out_pixel += 1;
+            drwav_seek_to_pcm_frame(&stream->wav, 0);
+            rewind = true;
+            continue;
         }
 
-        in_line += in_pitch;
-        out_line += out_pitch;
+        is_last = true;
+        stream->at_end = true;
+        break;
     }
+
+    stream->buffer_frames[b] = (u32)frame_count;
+    stream->buffer_is_last[b] = is_last;
+    atomic_exchange_u64(&stream->buffer_states[b], MusicBuffer_Ready);
 }
 
-void DrawImageExt(Image image, Rectangle2 rect, Vector4 color, Rectangle2 uv)
+function THREAD_PROC(MusicDecodeThreadProc)
 {
-    u32 *pixels = (u32 *)out->pixels;
+    for (;;)
+    {
+        os_semaphore_wait_for(&g_state.music_semaphore, true);
 
-    rect = abs_r2(rect);
+        for (i32 i = 0; i < MUSIC_SLOT_COUNT; i += 1)
+        {
+            Music_Stream *stream = &g_state.music[i];
+            if (!atomic_add_u64(&stream->open, 0)) continue;
 
-    i32 width = (i32)r2_width(rect);
-    i32 height = (i32)r2_height(rect);
+            // NOTE(nick): fill both halves if the mixer got through both of them
+            for (i32 n = 0; n < 2; n += 1)
+            {
+                u32 b = stream->next_decode_buffer;
+                if (atomic_add_u64(&stream->buffer_states[b], 0) != MusicBuffer_Empty) break;
 
-    i32 in_x0 = Clamp((i32)rect.x0, 0, out->width);
-    i32 in_y0 = Clamp((i32)rect.y0, 0, out->height);
+                b32 rewind = atomic_exchange_u64(&stream->rewind_pending, 0) != 0;
+                if (stream->at_end && !rewind) break;
 
-    i32 in_x1 = Clamp((i32)rect.x1, 0, out->width);
-    i32 in_y1 = Clamp((i32)rect.y1, 0, out->height);
+                atomic_exchange_u64(&stream->buffer_states[b], MusicBuffer_Decoding);
+                MusicDecodeBuffer(stream, b, rewind);
+                stream->next_decode_buffer = b ^ 1;
+            }
+        }
+    }
 
-    if (in_x0 == in_x1 || in_y0 == in_y1) return;
-    if (image.size.width == 0 || image.size.height == 0) return;
+    return 0;
+}
 
-    i32 src_pos_x = in_x0 - (i32)rect.x0;
-    i32 src_pos_y = in_y0 - (i32)rect.y0;
-    
-    u32 *samples = image.pixels;
-    u32 *at = &pixels[in_y0 * out->width + in_x0];
+// NOTE(nick): mixer, the decode thread seeks back to the start before it fills the next buffer
+function void MusicRestart(Music_Stream *stream)
+{
+    stream->finished = false;
+    stream->restart_pending = false;
+    atomic_exchange_u64(&stream->rewind_pending, 1);
+    os_semaphore_signal(&g_state.music_semaphore);
+}
 
-    b32 color_is_white = color.r == 1 && color.g == 1 && color.b == 1 && color.a == 1;
+// NOTE(nick): mixer, when decoding falls behind the rest of the block is left silent
+function void MusicMix(Music_Stream *stream, f32 *bus, i64 frame_count, f32 volume)
+{
+    i64 done = 0;
 
-    for (i32 y = in_y0; y < in_y1; y += 1)
+    while (done < frame_count)
     {
-        for (i32 x = in_x0; x < in_x1; x += 1)
-        {
-            f32 u = ((x - in_x0 + src_pos_x) + 0.5) / (f32)(width);
-            f32 v = ((y - in_y0 + src_pos_y) + 0.5) / (f32)(height);
-
-            // remap to input uv range
-            u = uv.x0 + u * (uv.x1 - uv.x0);
-            v = uv.y0 + v * (uv.y1 - uv.y0);
+        u32 b = stream->play_buffer;
+        if (atomic_add_u64(&stream->buffer_states[b], 0) != MusicBuffer_Ready) break;
 
-            if (u < 0) u += 1;
-            if (v < 0) v += 1;
-            if (u > 1) u -= 1;
-            if (v > 1) v -= 1;
+        u32 count = (u32)Min(stream->buffer_frames[b] - stream->play_offset, frame_count - done);
+        simd_mix_i16(bus + done * 2, stream->buffers[b] + stream->play_offset * 2, (i64)count * 2, volume);
 
-            i32 sample_x = floor_i32(u * (image.size.width)) % image.size.width;
-            i32 sample_y = floor_i32(v * (image.size.height)) % image.size.height;
-            sample_x = Max(sample_x, 0);
-            sample_y = Max(sample_y, 0);
+        done += count;
+        stream->play_offset += count;
 
-            assert((sample_x >= 0 && sample_x < image.size.width) && (sample_y >= 0 && sample_y < image.size.height));
+        if (stream->play_offset >= stream->buffer_frames[b])
+        {
+            b32 is_last = stream->buffer_is_last[b];
 
-            u32 sample_color = image.pixels[sample_y * image.size.width + sample_x];
+            stream->play_offset = 0;
+            stream->play_buffer = b ^ 1;
+            atomic_exchange_u64(&stream->buffer_states[b], MusicBuffer_Empty);
+            os_semaphore_signal(&g_state.music_semaphore);
 
-            if ((sample_color & 0xff000000) != 0)
+            if (is_last)
             {
-                if (color_is_white)
-                {
-                    *at = sample_color;
-                }
-                else
+                if (stream->restart_pending)
                 {
-                    *at = u32_rgba_from_v4(v4_rgba_from_u32(sample_color) * color);
+                    MusicRestart(stream);
+                    continue;
                 }
-            }
 
-            at += 1;
+                stream->playing = false;
+                stream->finished = true;
+                break;
+            }
         }
-
-        at += out->width - (in_x1 - in_x0);
     }
 }
 
-void DrawImageMirrored(Image image, Vector2 pos, b32 flip_x, b32 flip_y)
+Music LoadMusic(String path)
 {
-    Rectangle2 dest = r2(pos, pos + v2_from_v2i(image.size));
-    Rectangle2 uv = r2_from_f32(0, 0, 1, 1);
-    if (flip_x) { uv.x0 = 1; uv.x1 = 0; }
-    if (flip_y) { uv.y0 = 1; uv.y1 = 0; }
-    DrawImageExt(image, dest, v4_white, uv);
-}
+    Music result = {0};
 
-Font_Glyph FontGetGlyph(Font font, u32 character)
-{
-    Font_Glyph result = font.glyphs[0];
+    u64 hash = murmur64(path.data, path.count);
 
-    for (int index = 1; index < font.glyph_count; index += 1)
+    Music_Stream *stream = NULL;
+    for (i32 i = 0; i < MUSIC_SLOT_COUNT; i += 1)
     {
-        Font_Glyph *it = &font.glyphs[index];
-        if (it->character == character)
+        Music_Stream *it = &g_state.music[i];
+        if (it->open && it->hash == hash)
         {
-            result = *it;
-            break;
+            result.index = i + 1;
+            return result;
         }
-    }
-
-    return result;
-}
 
+        if (!it->open && !stream)
+        {
+            stream = it;
+        }
+    }
 
-Vector2 MeasureText(Font font, String text)
-{
-    Vector2 result = {0};
+    if (!stream)
+    {
+        print("[LoadMusic] Used all %d slots available! Failed to load music: %.*s\n", MUSIC_SLOT_COUNT, LIT(path));
+        return result;
+    }
 
-    f32 line_height = 0;
+    M_Temp scratch = GetScratch(0, 0);
+    char *path_c = string_to_cstr(scratch.arena, path_join(g_state.data_path, path));
+    b32 success = drwav_init_file(&stream->wav, path_c, NULL);
+    ReleaseScratch(scratch);
 
-    String32 unicode_text = string32_from_string(temp_arena(), text);
-    for (i32 i = 0; i < unicode_text.count; i += 1)
+    if (!success)
     {
-        u32 character = unicode_text.data[i];
-        Font_Glyph glyph = FontGetGlyph(font, character);
-
-        result.x += glyph.xadvance;
-        result.y = Max(result.y, glyph.size.y);
+        print("[LoadMusic] Music not found: %.*s\n", LIT(path));
+        return result;
     }
 
-    return result;
-}
+    if (stream->wav.channels != 2 || stream->wav.sampleRate != 44100)
+    {
+        print("[LoadMusic] Music has to be 44100Hz stereo: %.*s\n", LIT(path));
+        drwav_uninit(&stream->wav);
+        return result;
+    }
 
-void DrawTextExt(Font font, String text, Vector2 pos, Vector4 color, Vector2 anchor, f32 scale)
-{
-    if (scale <= 0) scale = 1.0;
-    
-    Vector2 cursor = pos;
-    if (!v2_is_zero(anchor))
+    if (stream->wav.totalPCMFrameCount == 0)
     {
-        Vector2 size = MeasureText(font, text);
-        cursor -= size * anchor * scale;
+        print("[LoadMusic] Music is empty: %.*s\n", LIT(path));
+        drwav_uninit(&stream->wav);
+        return result;
     }
 
-    String32 unicode_text = string32_from_string(temp_arena(), text);
-    for (i32 i = 0; i < unicode_text.count; i += 1)
+    // NOTE(nick): slots are never closed, so the window is allocated once per slot
+    if (!stream->buffers[0])
     {
-        u32 character = unicode_text.data[i];
-        Font_Glyph glyph = FontGetGlyph(font, character);
+        i16 *window = PushArray(g_state.arena, i16, MUSIC_WINDOW_FRAMES * 2 * 2);
+        stream->buffers[0] = window;
+        stream->buffers[1] = window + MUSIC_WINDOW_FRAMES * 2;
+    }
 
-        Rectangle2 uv = r2(
-            (v2_from_v2i(glyph.pos)) / (v2_from_v2i(font.image.size)),
-            (v2_from_v2i(glyph.pos) + v2_from_v2i(glyph.size)) / (v2_from_v2i(font.image.size))
-        );
+    stream->hash = hash;
+    atomic_exchange_u64(&stream->open, 1);
 
-        if (color.a > 0)
-        {
-            Vector2 pos = cursor;
-            pos += v2_from_v2i(glyph.line_offset) * scale;
-            DrawImageExt(font.image, r2(pos, pos + v2_from_v2i(glyph.size) * scale), color, uv);
-        }
+    // NOTE(nick): start decoding right away so it's ready by the time it's played
+    os_semaphore_signal(&g_state.music_semaphore);
 
-        cursor.x += glyph.xadvance * scale;
-    }
+    result.index = (i32)(stream - g_state.music) + 1;
+    return result;
 }
 
-void DrawText(Font font, String text, Vector2 pos)
+void MixerPlayMusic(Music music, f32 volume, b32 looping)
 {
-    DrawTextExt(font, text, pos, v4_white, v2_zero, 1);
-}
+    Music_Stream *stream = MusicFromHandle(music);
+    if (!stream) return;
 
-void DrawTextAlign(Font font, String text, Vector2 pos, Vector2 anchor)
-{
-    DrawTextExt(font, text, pos, v4_white, anchor, 1);
+    stream->looping = looping;
+
+    Mix_Command command = {0};
+    command.type = MixCommand_PlayMusic;
+    command.music = music;
+    command.value = clamp_f32(volume, 0, 2);
+    MixerPushCommand(command);
 }
 
-void DrawClear(Vector4 color)
+void MixerPauseMusic(Music music)
 {
-    DrawRect(r2(v2(0, 0), v2(out->width, out->height)), color);
+    if (!MusicFromHandle(music)) return;
+
+    Mix_Command command = {0};
+    command.type = MixCommand_PauseMusic;
+    command.music = music;
+    MixerPushCommand(command);
 }
 
 //
-// Sound API
+// NOTE(nick): mixing, these run on whichever thread mixes
 //
 
-#define MAX_CONCURRENT_SOUNDS ((f32)8)
-#define MAX_SOUND_SIZE (I16_MAX * (1.0 / MAX_CONCURRENT_SOUNDS))
-
-void PlaySine(f32 tone_hz, u32 sample_offset, f32 volume)
+function void MixerDrainCommands(Mixer *mixer)
 {
-    volume = clamp_f32(volume, 0, 2);
-
-    int wave_period = out->samples_per_second / tone_hz;
-    f32 t_sine = sample_offset * TAU / (f32)wave_period;
-    t_sine = Mod(t_sine, TAU);
+    u64 write_index = atomic_add_u64(&mixer->command_write_index, 0);
+    u64 read_index = mixer->command_read_index;
 
-    i16 *sample_out = out->samples;
-    for (int sample_index = 0; sample_index < out->sample_count; sample_index++)
+    for (; read_index < write_index; read_index += 1)
     {
-        f32 sine_value   = sin_f32(t_sine);
-        i16 sample_value = (i16)(sine_value * volume * MAX_SOUND_SIZE);
-        *sample_out++ += sample_value;
-        *sample_out++ += sample_value;
+        Mix_Command *command = &mixer->commands[read_index & (MIX_COMMAND_QUEUE_SIZE - 1)];
 
-        t_sine += TAU / (f32)wave_period;
-        if (t_sine >= TAU) {
-            t_sine -= TAU;
+        Mix_Voice *voice = NULL;
+        if (command->type >= MixCommand_VoiceStop)
+        {
+            voice = &mixer->voices[command->voice.index];
+            if (!voice->active || voice->generation != command->voice.generation) continue;
         }
-    }
-}
 
-void PlaySquare(f32 tone_hz, u32 sample_offset, f32 volume)
-{
-    volume = clamp_f32(volume, 0, 2);
+        switch (command->type)
+        {
+            case MixCommand_PlaySound:
+            {
+                if (mixer->playing_sounds.count < mixer->playing_sounds.capacity)
+                {
+                    Playing_Sound play = {0};
+                    play.sound = command->sound;
+                    play.volume = command->value;
+                    array_add(&mixer->playing_sounds, play);
+                }
+            } break;
 
-    f32 wave_period = (f32)out->samples_per_second / tone_hz;
-    f32 t_sine = sample_offset * TAU / wave_period;
-    t_sine = Mod(t_sine, TAU);
+            case MixCommand_SetMasterVolume:
+            {
+                mixer->master_volume = command->value;
+            } break;
 
-    i16 *sample_out = out->samples;
-    for (int sample_index = 0; sample_index < out->sample_count; sample_index++)
-    {
-        f32 sine_value   = t_sine <= PI ? 1.0 : -1.0;
-        i16 sample_value = (i16)(sine_value * volume * MAX_SOUND_SIZE);
-        *sample_out++ += sample_value;
-        *sample_out++ += sample_value;
+            case MixCommand_SetLimiter:
+            {
+                mixer->limiter = command->value != 0;
+                mixer->limiter_gain = 1.0;
+            } break;
 
-        t_sine += TAU / (f32)wave_period;
-        if (t_sine >= TAU) {
-            t_sine -= TAU;
-        }
-    }
-}
+            case MixCommand_PlayMusic:
+            {
+                Music_Stream *stream = &g_state.music[command->music.index - 1];
 
-void PlayTriangle(f32 tone_hz, u32 sample_offset, f32 volume)
-{
-    volume = clamp_f32(volume, 0, 2);
+                // NOTE(nick): once the end is decoded the restart has to wait until it's played (the
+                // game can't tell it's about to finish)
+                b32 end_decoded = false;
+                for (u32 b = 0; b < 2; b += 1)
+                {
+                    if (atomic_add_u64(&stream->buffer_states[b], 0) == MusicBuffer_Ready && stream->buffer_is_last[b])
+                    {
+                        end_decoded = true;
+                    }
+                }
 
-    f32 wave_period = (f32)out->samples_per_second / tone_hz;
-    f32 t_sine = sample_offset * TAU / (f32)wave_period;
-    t_sine = Mod(t_sine, TAU);
+                if (stream->finished) MusicRestart(stream);
+                else if (stream->playing && end_decoded) stream->restart_pending = true;
 
-    i16 *sample_out = out->samples;
-    for (i32 sample_index = 0; sample_index < out->sample_count; sample_index++)
-    {
-        f32 triangle_value   = 1.0 - 2.0 * abs_f32(t_sine / PI - 1.0);
+                stream->playing = true;
+                stream->volume = command->value;
+            } break;
 
-        i16 sample_value = (i16)(triangle_value * volume * MAX_SOUND_SIZE);
-        *sample_out++ += sample_value;
-        *sample_out++ += sample_value;
+            case MixCommand_PauseMusic:
+            {
+                Music_Stream *stream = &g_state.music[command->music.index - 1];
+                stream->playing = false;
+                stream->restart_pending = false;
+            } break;
 
-        t_sine += TAU / (f32)wave_period;
-        if (t_sine >= TAU) {
-            t_sine -= TAU;
+            case MixCommand_VoiceStart:
+            {
+                // NOTE(nick): takes over whatever was playing in the slot
+                voice = &mixer->voices[command->voice.index];
+
+                MemoryZero(voice, sizeof(Mix_Voice));
+                voice->generation = command->voice.generation;
+                voice->active = true;
+                voice->waveform = command->waveform;
+                voice->tone_hz = command->tone_hz;
+                voice->volume = command->value;
+                voice->envelope = command->envelope;
+                voice->stage = Envelope_Attack;
+            } break;
+
+            case MixCommand_VoiceStop:
+            {
+                if (voice->stage != Envelope_Release)
+                {
+                    voice->stage = Envelope_Release;
+                    voice->release_rate = voice->envelope.release > 0 ? voice->level / voice->envelope.release : F32_MAX;
+                }
+            } break;
+
+            case MixCommand_VoiceSetTone:
+            {
+                voice->tone_hz = command->value;
+            } break;
+
+            case MixCommand_VoiceSetVolume:
+            {
+                voice->volume = command->value;
+            } break;
         }
     }
+
+    atomic_exchange_u64(&mixer->command_read_index, read_index);
 }
 
-void PlaySawtooth(f32 tone_hz, u32 sample_offset, f32 volume)
+function void MixerRender(Mixer *mixer, f32 *bus, i64 frame_count, i32 samples_per_second)
 {
-    volume = clamp_f32(volume, 0, 2);
+    MixerDrainCommands(mixer);
 
-    f32 wave_period = (f32)out->samples_per_second / tone_hz;
-    f32 t_sine = sample_offset * TAU / (f32)wave_period;
-    t_sine = Mod(t_sine, TAU);
+    if (frame_count <= 0) return;
 
-    i16 *sample_out = out->samples;
-    for (int sample_index = 0; sample_index < out->sample_count; sample_index++)
+    Playing_Sound_Array *sounds = &mixer->playing_sounds;
+
+    for (i64 index = sounds->count - 1; index >= 0; index -= 1)
     {
-        f32 sawtooth_value   = t_sine / PI - 1.0;
-        i16 sample_value = (i16)(sawtooth_value * volume * MAX_SOUND_SIZE);
-        *sample_out++ += sample_value;
-        *sample_out++ += sample_value;
+        Playing_Sound *sound = &sounds->data[index];
+        sound->sample_offset += SoundMix(bus, frame_count, sound->sound, sound->sample_offset, mixer->master_volume * sound->volume);
 
-        t_sine += TAU / (f32)wave_period;
-        if (t_sine >= TAU) {
-            t_sine -= TAU;
+        if (sound->sample_offset >= sound->sound.total_samples)
+        {
+            array_remove_ordered(sounds, index);
         }
     }
-}
-
-void PlayNoise(f32 volume)
-{
-    volume = clamp_f32(volume, 0, 2);
-
-    Random_PCG *rng = &g_state.rng;
 
-    i16 *sample_out = out->samples;
-    for (int sample_index = 0; sample_index < out->sample_count; sample_index++)
+    for (i32 i = 0; i < MUSIC_SLOT_COUNT; i += 1)
     {
-        f32 random_value = random_pcg_between_f32(rng, -1.0, 1.0);
-        i16 sample_value = (i16)(random_value * volume * MAX_SOUND_SIZE);
-        *sample_out++ += sample_value;
-        *sample_out++ += sample_value;
+        Music_Stream *stream = &g_state.music[i];
+        if (stream->playing)
+        {
+            MusicMix(stream, bus, frame_count, mixer->master_volume * stream->volume);
+        }
     }
+
+    VoiceBankRender(mixer, bus, frame_count, samples_per_second);
 }
 
-u32 PlaySoundStream(Sound sound, u32 sample_offset, f32 volume)
+function void MixerOutput(Mixer *mixer, i16 *dest, f32 *bus, i64 frame_count, i32 samples_per_second)
 {
-    Sound_Asset *asset = (Sound_Asset *)GetAssetByIndex(&g_state.sounds, sizeof(Sound_Asset), count_of(g_state.sounds), sound.index); 
-    if (!asset) return 0;
-
-    volume = clamp_f32(volume, 0, 2);
-
-    i16 *samples = out->samples;
-
-    i16 *at = (i16 *)((u8 *)sound.samples + sample_offset * sizeof(i16) * 2);
-
-    u32 samples_remaining = sound.total_samples - sample_offset;
+    if (frame_count <= 0) return;
 
-    u32 sample_count = Min(out->sample_count, samples_remaining);
+    f32 gain = 1.0;
+    f32 gain_step = 0;
 
-    for (int sample_index = 0; sample_index < sample_count; sample_index++)
+    if (mixer->limiter)
     {
-        *samples++ += *at * (volume / MAX_CONCURRENT_SOUNDS);
-        at += 1;
+        // NOTE(nick): the gain drops to the block's safe level right away (the jump lands on the
+        // loud block so it isn't heard as a click) and ramps back up to 1 over the release time
+        f32 peak = simd_mix_peak(bus, frame_count * 2);
+        f32 target = peak > I16_MAX ? I16_MAX / peak : 1.0;
 
-        *samples++ += *at * (volume / MAX_CONCURRENT_SOUNDS);
-        at += 1;
+        f32 current = mixer->limiter_gain;
+        if (target < current)
+        {
+            gain = target;
+            mixer->limiter_gain = target;
+        }
+        else
+        {
+            f32 release = frame_count / (MIX_LIMITER_RELEASE_SECONDS * samples_per_second);
+            f32 next = Min(current + release, target);
+
+            gain = current;
+            gain_step = (next - current) / frame_count;
+            mixer->limiter_gain = next;
+        }
     }
 
-    return sample_count;
+    simd_mix_output(dest, bus, frame_count, gain, gain_step);
 }
 
-void MixerPlaySound(Sound sound, f32 volume)
+void GameMixAudio(i16 *samples, f32 *mix_samples, i32 frame_count, i32 samples_per_second)
 {
-    Playing_Sound play = {0};
-    play.sound = sound;
-    play.volume = volume;
+    Mixer *mixer = &g_state.mixer;
 
-    if (g_state.playing_sounds.count < g_state.playing_sounds.capacity)
+    i64 count = (i64)frame_count * 2;
+    if (count > mixer->bus_capacity)
     {
-        array_add(&g_state.playing_sounds, play);
+        if (mixer->bus) os_free(mixer->bus);
+        mixer->bus = (f32 *)os_alloc(count * sizeof(f32));
+        mixer->bus_capacity = count;
     }
-}
 
-void MixerSetMasterVolume(f32 master_volume)
-{
-    g_state.master_volume = Clamp(master_volume, 0.0, 1.0);
-}
-
-void MixerOutputPlayingSounds()
-{
-    Playing_Sound_Array *sounds = &g_state.playing_sounds;
-
-    f32 master_volume = g_state.master_volume;
-
-    for (i64 index = sounds->count - 1; index >= 0; index -= 1)
+    if (count > 0)
     {
-        Playing_Sound *sound = &sounds->data[index];
-        sound->sample_offset += PlaySoundStream(sound->sound, sound->sample_offset, master_volume * sound->volume);
-
-        if (sound->sample_offset >= sound->sound.total_samples)
+        if (mix_samples)
         {
-            array_remove_ordered(sounds, index);
+            MemoryCopy(mixer->bus, mix_samples, count * sizeof(f32));
+        }
+        else
+        {
+            MemoryZero(mixer->bus, count * sizeof(f32));
         }
     }
+
+    MixerRender(mixer, mixer->bus, frame_count, samples_per_second);
+    MixerOutput(mixer, samples, mixer->bus, frame_count, samples_per_second);
 }
@@ -32,6 +32,24 @@ enum {
     Mouse_COUNT,
 };
 
+// NOTE(nick): a packed 8-bit color with red in the low byte and straight alpha in the high byte,
+// the Draw*32 calls take these and skip converting from Vector4
+typedef u32 Color32;
+
+typedef u32 Blend_Mode;
+enum {
+    // NOTE(nick): straight alpha colors, premultiplied images (the default)
+    Blend_Alpha = 0,
+    // NOTE(nick): colors are already premultiplied by their alpha
+    Blend_Premultiplied,
+    Blend_Additive,
+    Blend_Multiply,
+    // NOTE(nick): overwrite destination pixels
+    Blend_None,
+
+    Blend_COUNT,
+};
+
 struct Controller
 {
     b32 up;
@@ -77,11 +95,47 @@ struct Game_Output
     i32 height;
     u32 *pixels;
 
+    // NOTE(nick): the 8-bit screen used in palette mode, width * height bytes
+    u8 *indices;
+
     // Audio
     i32 samples_per_second;
     i32 sample_count;
     i16 *samples;
     i32 samples_played;
+    // NOTE(nick): set when the platform calls GameMixAudio from its own audio thread, samples is left
+    // alone then and GameEndFrame points mix_samples at what the Play* calls mixed this frame instead
+    b32 mix_on_audio_thread;
+    // NOTE(nick): sample_count stereo frames in i16 units that aren't clamped yet, so the limiter in
+    // GameMixAudio still sees their peaks
+    f32 *mix_samples;
+
+    // Dirty Rects (filled in by GameEndFrame)
+    b32 keep_previous_frame;
+    Rectangle2i *dirty_rects;
+    i32 dirty_rect_count;
+
+    // Palette (filled in by GameEndFrame)
+    // NOTE(nick): in palette mode the platform fills pixels from indices before presenting, every
+    // pixel has to be looked up again when the palette changed
+    b32 palette_mode;
+    b32 palette_changed;
+    u32 *palette;
+};
+
+struct Image_Run
+{
+    i32 x0;
+    i32 x1;
+    b32 opaque;
+};
+
+struct Image_Spans
+{
+    // NOTE(nick): the runs of row y are runs[row_offsets[y]] up to runs[row_offsets[y + 1]],
+    // fully transparent pixels are left out
+    u32 *row_offsets;
+    Image_Run *runs;
 };
 
 struct Image
@@ -89,6 +143,24 @@ struct Image
     Vector2i size;
     u32 *pixels;
     i64 index;
+
+    // NOTE(nick): optional, lets blits skip transparent pixels and copy opaque ones
+    Image_Spans *spans;
+
+    // NOTE(nick): row y starts at pixels + y * stride, zero means the rows are tightly packed
+    i32 stride;
+
+    // NOTE(nick): trimmed images only store the texels inside of trim, the rest are transparent.
+    // size is still the untrimmed size and spans are relative to the trim rect.
+    b32 trimmed;
+    Rectangle2i trim;
+};
+
+// NOTE(nick): 8-bit palette indices, 0 is transparent
+struct Image_Indexed
+{
+    Vector2i size;
+    u8 *indices;
 };
 
 struct Sound
@@ -102,6 +174,40 @@ struct Sound
     i64 index;
 };
 
+typedef u32 Waveform;
+enum {
+    Waveform_Sine = 0,
+    Waveform_Square,
+    Waveform_Triangle,
+    Waveform_Sawtooth,
+    // NOTE(nick): tone_hz is how many new random values are picked per second
+    Waveform_Noise,
+
+    Waveform_COUNT,
+};
+
+// NOTE(nick): times are in seconds, sustain is the level held (0 to 1) until the voice is stopped
+struct Envelope
+{
+    f32 attack;
+    f32 decay;
+    f32 sustain;
+    f32 release;
+};
+
+// NOTE(nick): handle to a voice in the mixer's voice bank, the zero value is never a playing voice
+struct Voice
+{
+    u32 index;
+    u32 generation;
+};
+
+// NOTE(nick): handle to a streamed music track, the zero value is no music
+struct Music
+{
+    i32 index;
+};
+
 struct Font_Glyph
 {
     u32 character;
@@ -112,12 +218,111 @@ struct Font_Glyph
     i32 xadvance;
 };
 
+struct Font_Glyph_Table
+{
+    // NOTE(nick): glyph indices for Latin-1, zero is the fallback glyph
+    u32 latin1[256];
+
+    // NOTE(nick): open addressed hash for the rest of unicode, a zero value is an empty slot
+    u32 *keys;
+    u32 *values;
+    u32 mask;
+
+    // NOTE(nick): height of the tallest glyph
+    i32 line_height;
+};
+
 struct Font
 {
     Image image;
 
     Font_Glyph *glyphs;
     u32 glyph_count;
+
+    Font_Glyph_Table *table;
+};
+
+struct Sprite
+{
+    Image image;
+    Rectangle2 rect;
+    Rectangle2 uv;
+    Vector4 color;
+
+    b32 flip_x;
+    b32 flip_y;
+
+    // NOTE(nick): lower layers are drawn first
+    i32 layer;
+};
+
+struct Tilemap_Chunk
+{
+    Image image;
+    b32 dirty;
+    b32 empty;
+};
+
+// NOTE(nick): tile 0 is empty and tile i draws cell i - 1 of the tileset, counting left to right and
+// top to bottom. Tiles are pre-rendered chunk_size x chunk_size at a time into cached chunk images
+// that get redrawn when one of their tiles changes.
+struct Tilemap
+{
+    Vector2i size;
+    u16 *tiles;
+
+    Image tileset;
+    Vector2i tile_size;
+    i32 chunk_size;
+
+    Vector2i chunk_count;
+    Tilemap_Chunk *chunks;
+};
+
+struct Particle_Emitter
+{
+    b32 active;
+
+    // NOTE(nick): particles spawn at pos plus or minus pos_spread, the other spreads work the same way
+    Vector2 pos;
+    Vector2 pos_spread;
+    Vector2 velocity;
+    Vector2 velocity_spread;
+    f32 lifetime;
+    f32 lifetime_spread;
+
+    // NOTE(nick): particles fade from start_color to end_color over their lifetime
+    Vector4 start_color;
+    Vector4 end_color;
+    // NOTE(nick): in pixels, sizes of 1 or less draw single pixels
+    f32 size;
+
+    // NOTE(nick): particles per second, emitted by ParticleSystemUpdate
+    f32 rate;
+    f32 emit_accumulator;
+};
+
+// NOTE(nick): every particle field is its own array, so they're updated LANE_WIDTH particles at a time
+struct Particle_System
+{
+    i32 capacity;
+    i32 count;
+
+    f32 *x, *y;
+    f32 *vx, *vy;
+    f32 *life;
+    f32 *size;
+    f32 *r, *g, *b, *a;
+    f32 *dr, *dg, *db, *da;
+
+    Particle_Emitter *emitters;
+    i32 emitter_capacity;
+
+    Vector2 gravity;
+    // NOTE(nick): fraction of the velocity lost every second
+    f32 drag;
+    // NOTE(nick): splits big updates across the work queue
+    b32 use_work_queue;
 };
 
 //
@@ -127,6 +332,11 @@ struct Font
 void GameInit();
 void GameSetState(Game_Input *input, Game_Output *out, Game_Input *prev_input);
 void GameUpdateAndRender(Game_Input *input, Game_Output *out);
+void GameEndFrame();
+// NOTE(nick): mixes the next frame_count frames of the sounds and voices with mix_samples (frames taken
+// from Game_Output.mix_samples, or NULL) and writes the result to samples, safe to call from an audio
+// thread while the game is running
+void GameMixAudio(i16 *samples, f32 *mix_samples, i32 frame_count, i32 samples_per_second);
 
 //
 // Controller API
@@ -145,30 +355,120 @@ b32 MouseDown(Mouse_Button button);
 // Drawing API
 //
 
+void DrawSetBlendMode(Blend_Mode mode);
+Blend_Mode DrawGetBlendMode();
+
+// NOTE(nick): record draw calls and rasterize them in parallel screen tiles at DrawEndDeferred
+// (or at the end of the frame)
+void DrawBeginDeferred();
+void DrawEndDeferred();
+
+// NOTE(nick): nothing outside of the clip rect gets drawn, DrawClear included. Pushed rects are
+// intersected with the current one and the stack is reset every frame.
+void PushClipRect(Rectangle2 rect);
+void PopClipRect();
+Rectangle2 DrawGetClipRect();
+
+// NOTE(nick): retargets every Draw* call to the image until the matching EndDrawToImage, targets
+// nest. The image can't be trimmed or share an atlas page (use ImageMake). Pending deferred draws
+// are flushed first and drawing into an image is never deferred. EndDrawToImage rebuilds the spans
+// of the image (and of the cached LoadImage copies), other copies made before then shouldn't be drawn.
+void BeginDrawToImage(Image *image);
+void EndDrawToImage();
+
+// NOTE(nick): start every frame with the pixels of the last one, only the regions that were drawn
+// to get presented again
+void DrawSetKeepPreviousFrame(b32 keep);
+
+Color32 Color32FromRGBA(u8 r, u8 g, u8 b, u8 a);
+Color32 Color32FromVector4(Vector4 color);
+
 void DrawSetPixel(Vector2 pos, Vector4 color);
+void DrawSetPixel32(Vector2 pos, Color32 color);
 u32 DrawGetPixel(Vector2 pos);
 
 void DrawRect(Rectangle2 rect, Vector4 color);
+void DrawRect32(Rectangle2 rect, Color32 color);
 void DrawRectExt(Rectangle2 rect, Vector4 c0, Vector4 c1, Vector4 c2, Vector4 c3);
+void DrawRectExt32(Rectangle2 rect, Color32 c0, Color32 c1, Color32 c2, Color32 c3);
 void DrawRectOutline(Rectangle2 rect, Vector4 color, int thickness);
+void DrawRectOutline32(Rectangle2 rect, Color32 color, int thickness);
 
 void DrawCircle(Vector2 pos, f32 radius, Vector4 color);
+void DrawCircle32(Vector2 pos, f32 radius, Color32 color);
+void DrawCircleOutline(Vector2 pos, f32 radius, Vector4 color, f32 thickness);
+void DrawCircleOutline32(Vector2 pos, f32 radius, Color32 color, f32 thickness);
+void DrawEllipse(Vector2 pos, Vector2 radius, Vector4 color);
+void DrawEllipse32(Vector2 pos, Vector2 radius, Color32 color);
+void DrawEllipseOutline(Vector2 pos, Vector2 radius, Vector4 color, f32 thickness);
+void DrawEllipseOutline32(Vector2 pos, Vector2 radius, Color32 color, f32 thickness);
+// NOTE(nick): a thickness of zero fills the ellipse
+void DrawEllipseExt(Vector2 pos, Vector2 radius, Vector4 color, f32 thickness, b32 anti_aliased);
+void DrawEllipseExt32(Vector2 pos, Vector2 radius, Color32 color, f32 thickness, b32 anti_aliased);
 
 void DrawTriangle(Vector2 p0, Vector2 p1, Vector2 p2, Vector4 color);
+void DrawTriangle32(Vector2 p0, Vector2 p1, Vector2 p2, Color32 color);
 void DrawTriangleExt(Vector2 p0, Vector4 c0, Vector2 p1, Vector4 c1, Vector2 p2, Vector4 c2);
+void DrawTriangleExt32(Vector2 p0, Color32 c0, Vector2 p1, Color32 c1, Vector2 p2, Color32 c2);
 
 void DrawLine(Vector2 p0, Vector2 p1, Vector4 color);
+void DrawLine32(Vector2 p0, Vector2 p1, Color32 color);
+// NOTE(nick): draws a line between each pair of points
+void DrawLines(Vector2 *points, i64 count, Vector4 color);
+void DrawLines32(Vector2 *points, i64 count, Color32 color);
+void DrawPolyline(Vector2 *points, i64 count, Vector4 color, b32 closed);
+void DrawPolyline32(Vector2 *points, i64 count, Color32 color, b32 closed);
 
 void DrawImage(Image image, Vector2 pos);
-void DrawImageExt(Image image, Rectangle2 rect, Rectangle2 uv);
+void DrawImageExt(Image image, Rectangle2 rect, Vector4 color, Rectangle2 uv);
 void DrawImageMirrored(Image image, Vector2 pos, b32 flip_x, b32 flip_y);
 
+// NOTE(nick): draws sprites sorted by layer, sprites within a layer are grouped by image
+void DrawSprites(Sprite *sprites, i64 count);
+
+Tilemap TilemapMake(Image tileset, Vector2i tile_size, Vector2i size, i32 chunk_size);
+void TilemapSetTile(Tilemap *map, i32 x, i32 y, u16 tile);
+u16 TilemapGetTile(Tilemap *map, i32 x, i32 y);
+// NOTE(nick): redraws every chunk, for when the tileset pixels change or tiles were written directly
+void TilemapInvalidate(Tilemap *map);
+// NOTE(nick): only draws the chunks that overlap the clip rect, pos is rounded down to whole pixels
+void DrawTilemap(Tilemap *map, Vector2 pos);
+
+Particle_System ParticleSystemMake(i32 capacity, i32 emitter_capacity);
+// NOTE(nick): returns NULL when every emitter is in use
+Particle_Emitter *ParticleEmitterAdd(Particle_System *system);
+void ParticleEmitterRemove(Particle_System *system, Particle_Emitter *emitter);
+// NOTE(nick): spawns a burst of particles right away
+void ParticleEmit(Particle_System *system, Particle_Emitter *emitter, i32 count);
+void ParticleSystemUpdate(Particle_System *system, f32 dt);
+// NOTE(nick): particles aren't deferred, commands recorded before are flushed first
+void DrawParticles(Particle_System *system);
+
 Vector2 MeasureText(Font font, String text);
 void DrawText(Font font, String text, Vector2 pos);
 void DrawTextAlign(Font font, String text, Vector2 pos, Vector2 anchor);
 void DrawTextExt(Font font, String text, Vector2 pos, Vector4 color, Vector2 anchor, f32 scale);
+// NOTE(nick): breaks lines at newlines and between words to fit max_width
+Vector2 MeasureTextWrapped(Font font, String text, f32 max_width);
+void DrawTextWrapped(Font font, String text, Vector2 pos, Vector4 color, Vector2 anchor, f32 scale, f32 max_width);
 
 void DrawClear(Vector4 color);
+void DrawClear32(Color32 color);
+
+// NOTE(nick): palette mode, the screen holds indices into a 256 color palette instead of colors. Only
+// the *Index calls draw to it (and never deferred), the regular calls don't show up while it's on.
+void DrawSetPaletteMode(b32 enabled);
+void DrawSetPaletteColor(u8 index, Vector4 color);
+void DrawSetPalette(u8 first, Vector4 *colors, i32 count);
+Vector4 DrawGetPaletteColor(u8 index);
+// NOTE(nick): moves the colors of [first, first + count) up by shift, wrapping around
+void DrawRotatePalette(u8 first, i32 count, i32 shift);
+
+void DrawClearIndex(u8 index);
+void DrawSetPixelIndex(Vector2 pos, u8 index);
+u8 DrawGetPixelIndex(Vector2 pos);
+void DrawRectIndex(Rectangle2 rect, u8 index);
+void DrawImageIndexed(Image_Indexed image, Vector2 pos);
 
 //
 // Sound API
@@ -182,15 +482,49 @@ void PlayNoise(f32 volume);
 
 u32  PlaySoundStream(Sound sound, u32 sample_offset, f32 volume);
 
+// NOTE(nick): the Mixer* and Voice* calls are queued and take effect the next time audio is mixed,
+// which can be on another thread
 void MixerPlaySound(Sound sound, f32 volume);
 void MixerSetMasterVolume(f32 master_volume);
+// NOTE(nick): sounds from MixerPlaySound are mixed automatically, this does nothing
 void MixerOutputPlayingSounds();
+// NOTE(nick): resumes the music where it was paused, or starts it over once it has finished. Playing
+// it again once its end is decoded (within about 740ms of it) starts it over as soon as it ends
+void MixerPlayMusic(Music music, f32 volume, b32 looping);
+void MixerPauseMusic(Music music);
+// NOTE(nick): on by default, when off a mix that's too loud hard clips
+void MixerSetLimiter(b32 enabled);
+
+// NOTE(nick): voices keep playing across frames until they're stopped, when every voice is busy the
+// quietest one is taken over
+Voice VoiceStart(Waveform waveform, f32 tone_hz, f32 volume);
+Voice VoiceStartExt(Waveform waveform, f32 tone_hz, f32 volume, Envelope envelope);
+// NOTE(nick): starts the release, the voice is freed once it's silent
+void VoiceStop(Voice voice);
+void VoiceSetTone(Voice voice, f32 tone_hz);
+void VoiceSetVolume(Voice voice, f32 volume);
+b32  VoiceIsPlaying(Voice voice);
 
 //
 // Assets API
 //
 
 Image LoadImage(String path);
+// NOTE(nick): a transparent image to draw into
+Image ImageMake(Vector2i size);
+// NOTE(nick): matches every pixel to the closest color in the current palette, mostly transparent
+// pixels become index 0
+Image_Indexed ImageIndexedFromImage(Image image);
+// NOTE(nick): small images are packed into shared atlas pages as they're loaded, trimming also
+// strips their transparent borders (they still draw the same)
+void ImageAtlasSetTrim(b32 trim);
+// NOTE(nick): writes every image packed so far into one file, shipped builds can load it up front
+// so LoadImage finds those images already packed
+b32 SaveImageAtlas(String path);
+b32 LoadImageAtlas(String path);
 Sound LoadSound(String path);
+// NOTE(nick): keeps the file open and decodes a small window ahead of where it's playing on its own
+// thread instead of decoding the whole file up front like LoadSound, for long tracks
+Music LoadMusic(String path);
 Font LoadFont(String path, String alphabet, Vector2i monospaced_letter_size);
 Font LoadFontExt(String path, Font_Glyph *glyphs, u64 glyph_count);
@@ -63,39 +63,174 @@ function void sdl2__audio_callback2(void *user, Uint8 *stream, int len)
   }
 }
 
-struct Audio_Output
+//
+// NOTE(nick): single producer, single consumer ring of audio frames between two threads. The
+// indices are free running frame counts (they never wrap in practice), the producer only ever writes
+// write_index and the consumer only ever writes read_index. Each side publishes its index with a
+// release barrier after touching the frames and reads the other side's index with an acquire
+// barrier before touching them.
+//
+
+struct Audio_Ring
+{
+    u8 *frames;
+    u64 frame_size;
+    // NOTE(nick): in frames, always a power of two
+    u64 capacity;
+    u64 mask;
+
+    u64 volatile write_index;
+    u64 volatile read_index;
+};
+
+// NOTE(nick): audio is mixed in blocks by the mixing thread and played by the SDL callback,
+// audio_game carries the Play* output of each game frame over to the mixing thread as f32 frames so
+// it's only clamped once, after the limiter
+static Audio_Ring audio = {};
+static Audio_Ring audio_game = {};
+
+function void sdl2__audio_ring_init(Audio_Ring *ring, u64 min_capacity, u64 frame_size)
+{
+    u64 capacity = 1;
+    while (capacity < min_capacity) capacity <<= 1;
+
+    ring->frames = (u8 *)os_alloc(capacity * frame_size);
+    ring->frame_size = frame_size;
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+    ring->write_index = 0;
+    ring->read_index = 0;
+}
+
+// NOTE(nick): frames queued and not played yet, safe to call from either side
+function u64 sdl2__audio_ring_fill_level(Audio_Ring *ring)
+{
+    u64 read_index = ring->read_index;
+    SDL_MemoryBarrierAcquire();
+    u64 write_index = ring->write_index;
+    SDL_MemoryBarrierAcquire();
+
+    return write_index - read_index;
+}
+
+// NOTE(nick): producer only, copies in at most the free space and returns the frames written
+function u64 sdl2__audio_ring_write(Audio_Ring *ring, void *src, u64 frame_count)
+{
+    u64 read_index = ring->read_index;
+    SDL_MemoryBarrierAcquire();
+
+    u64 write_index = ring->write_index;
+    frame_count = Min(frame_count, ring->capacity - (write_index - read_index));
+
+    u64 at = write_index & ring->mask;
+    u64 first = Min(frame_count, ring->capacity - at);
+
+    u64 size = ring->frame_size;
+    MemoryCopy(ring->frames + at * size, src, first * size);
+    MemoryCopy(ring->frames, (u8 *)src + first * size, (frame_count - first) * size);
+
+    SDL_MemoryBarrierRelease();
+    ring->write_index = write_index + frame_count;
+
+    return frame_count;
+}
+
+// NOTE(nick): consumer only, returns the frames read
+function u64 sdl2__audio_ring_read(Audio_Ring *ring, void *dest, u64 frame_count)
 {
-    i64 playback_pos;
-    // i64 samples_played;
+    u64 write_index = ring->write_index;
+    SDL_MemoryBarrierAcquire();
+
+    u64 read_index = ring->read_index;
+    frame_count = Min(frame_count, write_index - read_index);
+
+    u64 at = read_index & ring->mask;
+    u64 first = Min(frame_count, ring->capacity - at);
+
+    u64 size = ring->frame_size;
+    MemoryCopy(dest, ring->frames + at * size, first * size);
+    MemoryCopy((u8 *)dest + first * size, ring->frames, (frame_count - first) * size);
+
+    SDL_MemoryBarrierRelease();
+    ring->read_index = read_index + frame_count;
+
+    return frame_count;
+}
+
+//
+// NOTE(nick): the mixing thread keeps the device ring topped up to one device period plus a block,
+// so sounds and voices only lag that far behind the game and a slow frame can't starve the device.
+// The callback wakes it up every time it takes frames out.
+//
+
+#define AUDIO_MIX_BLOCK_SIZE 256
 
-    u64 user_safe_size;
-    u8 *user_samples;
-    u8 *read;
-    u8 *write;
+struct Audio_Mixer
+{
+    SDL_Thread *thread;
+    SDL_sem *wake;
+    b32 volatile quit;
 
-    b32 wrapped;
+    u64 target_fill;
+    i32 samples_per_second;
 };
 
-static Audio_Output audio = {};
+static Audio_Mixer audio_mixer = {};
 
 function void sdl2__audio_callback(void *user, Uint8 *stream, int len)
 {
-    // u32 sample_count = len/(2 * sizeof(i16));
-    // audio.playback_pos += sample_count;
+    u64 frame_count = len / (2 * sizeof(i16));
+    u64 frames_read = sdl2__audio_ring_read(&audio, (i16 *)stream, frame_count);
 
-    if (audio.read + len <= audio.write || audio.wrapped)
-    {
-        MemoryCopy(stream, audio.read, len);
-        audio.read += len;
+    // NOTE(nick): on an underrun play silence for the rest, the frames that are late stay queued
+    MemoryZero(stream + frames_read * 2 * sizeof(i16), len - frames_read * 2 * sizeof(i16));
+
+    if (audio_mixer.wake) SDL_SemPost(audio_mixer.wake);
+}
+
+function int sdl2__audio_mix_thread(void *data)
+{
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
 
-        if (audio.read > audio.user_samples + audio.user_safe_size) {
-            audio.read = audio.user_samples;
-            audio.wrapped = false;
+    i16 block[AUDIO_MIX_BLOCK_SIZE * 2];
+    f32 game_block[AUDIO_MIX_BLOCK_SIZE * 2];
+
+    while (!audio_mixer.quit)
+    {
+        if (sdl2__audio_ring_fill_level(&audio) >= audio_mixer.target_fill)
+        {
+            // NOTE(nick): the timeout is just so quitting never waits on the device
+            SDL_SemWaitTimeout(audio_mixer.wake, 10);
+            continue;
         }
+
+        u64 game_frames = sdl2__audio_ring_read(&audio_game, game_block, AUDIO_MIX_BLOCK_SIZE);
+        MemoryZero(game_block + game_frames * 2, (AUDIO_MIX_BLOCK_SIZE - game_frames) * 2 * sizeof(f32));
+
+        GameMixAudio(block, game_block, AUDIO_MIX_BLOCK_SIZE, audio_mixer.samples_per_second);
+
+        sdl2__audio_ring_write(&audio, block, AUDIO_MIX_BLOCK_SIZE);
+    }
+
+    return 0;
+}
+
+function void sdl2__expand_palette(u32 *framebuffer, u8 *indices, Rectangle2i rect, u32 *palette)
+{
+    i32 width = r2i_width(rect);
+
+    // NOTE(nick): the whole screen is one contiguous run
+    if (width == game_width)
+    {
+        i64 offset = (i64)rect.y0 * game_width;
+        simd_palette_expand(framebuffer + offset, indices + offset, (i64)width * r2i_height(rect), palette);
+        return;
     }
-    else
+
+    for (i32 y = rect.y0; y < rect.y1; y += 1)
     {
-        MemoryZero(stream, len);
+        i64 offset = (i64)y * game_width + rect.x0;
+        simd_palette_expand(framebuffer + offset, indices + offset, width, palette);
     }
 }
 
@@ -138,6 +273,15 @@ int main()
     SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, game_width, game_height);
 
+    // NOTE(nick): the game draws into its own framebuffer so it can be kept between frames and only
+    // the dirty regions have to be uploaded to the texture
+    u32 *framebuffer = (u32 *)os_alloc(game_width * game_height * sizeof(u32));
+    i32 framebuffer_pitch = game_width * sizeof(u32);
+    b32 texture_is_stale = true;
+
+    // NOTE(nick): palette mode draws here instead and it's expanded into the framebuffer before uploading
+    u8 *index_buffer = (u8 *)os_alloc(game_width * game_height);
+
     Arena *permanant_storage = arena_alloc(Megabytes(64));
 
     SDL_AudioSpec want, have;
@@ -148,22 +292,21 @@ int main()
     want.samples = 512;
     want.callback = sdl2__audio_callback;
     SDL_AudioDeviceID audio_device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
-    SDL_PauseAudioDevice(audio_device, 0);
 
-    static i64 audio_samples_queued = 0;
-    static u8 *audio_user_samples = (u8 *)os_alloc(Megabytes(4));
-    static i64 audio_latency = 0;
+    sdl2__audio_ring_init(&audio, (u64)have.samples * 16, 2 * sizeof(i16));
+    sdl2__audio_ring_init(&audio_game, (u64)have.samples * 16, 2 * sizeof(f32));
 
-    // audio.user_samples = (u8 *)os_alloc(Megabytes(32));
-    audio.user_safe_size = Kilobytes(512);
-    audio.user_samples = (u8 *)os_alloc(audio.user_safe_size * 2);
-    audio.read = audio.user_samples;
-    audio.write = audio.user_samples;
+    SDL_PauseAudioDevice(audio_device, 0);
 
     // printf("[SDL] Obtained - frequency: %d format: f %d s %d be %d sz %d channels: %d samples: %d\n", have.freq, SDL_AUDIO_ISFLOAT(have.format), SDL_AUDIO_ISSIGNED(have.format), SDL_AUDIO_ISBIGENDIAN(have.format), SDL_AUDIO_BITSIZE(have.format), have.channels, have.samples);
 
     GameInit();
 
+    audio_mixer.target_fill = Min(have.samples + AUDIO_MIX_BLOCK_SIZE, audio.capacity);
+    audio_mixer.samples_per_second = 44100;
+    audio_mixer.wake = SDL_CreateSemaphore(0);
+    audio_mixer.thread = SDL_CreateThread(sdl2__audio_mix_thread, "pix16 mixer", NULL);
+
     f64 then = os_time();
     f64 accumulator = 0.0;
     f64 average_dt = 0.0;
@@ -353,56 +496,75 @@ int main()
         }
 
         static Game_Output output = {};
-        
-        int pitch;
-        u32 *pixels;
-        SDL_LockTexture(texture, NULL, (void**)&pixels, &pitch);
 
-        output.pixels = pixels;
+        output.pixels = framebuffer;
+        output.indices = index_buffer;
         output.width  = game_width;
         output.height = game_height;
 
-        i64 LatencySamples = have.samples * 4;
-        u64 SampleSize = 2 * sizeof(i16);
+        // NOTE(nick): keep enough of the Play* output queued to cover a device period plus two
+        // frames, so a frame that runs long doesn't leave a gap in it
+        u64 audio_target_fill = have.samples + (u64)(2 * target_dt * have.freq);
+        audio_target_fill = Min(audio_target_fill, audio_game.capacity);
 
-        i64 read_target = (i64)audio.read + LatencySamples * SampleSize;
-        i64 write_target = (i64)audio.write;
+        u64 audio_fill = sdl2__audio_ring_fill_level(&audio_game);
 
         u32 UserSampleCount = 0;
-        if (read_target >= write_target)
+        if (audio_fill < audio_target_fill)
         {
-            UserSampleCount = (read_target - write_target)/(SampleSize);
+            UserSampleCount = (u32)(audio_target_fill - audio_fill);
         }
 
-        // NOTE(nick): when wrapping, we would get a garbage value here
-        if (UserSampleCount > LatencySamples) UserSampleCount = LatencySamples;
-
-        i16 *UserSamples = (i16 *)audio.write;
-        MemoryZero(UserSamples, UserSampleCount * 2 * sizeof(i16));
-
+        // NOTE(nick): the game mixes into its own bus and the result is copied into the ring, so the
+        // game always sees one contiguous buffer even when the ring wraps
         output.samples_per_second = 44100;
         output.sample_count = UserSampleCount;
-        output.samples = (i16 *)UserSamples;
+        output.samples = NULL;
+        output.mix_samples = NULL;
+        output.mix_on_audio_thread = true;
 
         profiler__begin();
 
         GameSetState(&input, &output, &prev_input);
         GameUpdateAndRender(&input, &output);
+        GameEndFrame();
+
+        b32 upload_dirty_rects = output.keep_previous_frame && !texture_is_stale;
+        if (output.palette_mode && output.palette_changed) upload_dirty_rects = false;
+
+        if (upload_dirty_rects)
+        {
+            for (i32 i = 0; i < output.dirty_rect_count; i += 1)
+            {
+                Rectangle2i it = output.dirty_rects[i];
+
+                if (output.palette_mode)
+                {
+                    sdl2__expand_palette(framebuffer, index_buffer, it, output.palette);
+                }
+
+                SDL_Rect rect = {it.x0, it.y0, r2i_width(it), r2i_height(it)};
+                SDL_UpdateTexture(texture, &rect, framebuffer + it.y0 * game_width + it.x0, framebuffer_pitch);
+            }
+        }
+        else
+        {
+            if (output.palette_mode)
+            {
+                sdl2__expand_palette(framebuffer, index_buffer, r2i(0, 0, game_width, game_height), output.palette);
+            }
+
+            SDL_UpdateTexture(texture, NULL, framebuffer, framebuffer_pitch);
+            texture_is_stale = false;
+        }
 
         profiler__end();
         profiler__print();
 
-        SDL_UnlockTexture(texture);
-
         if (UserSampleCount > 0)
         {
-            audio.write += UserSampleCount * 2 * sizeof(i16);
+            sdl2__audio_ring_write(&audio_game, output.mix_samples, UserSampleCount);
             output.samples_played += UserSampleCount;
-
-            if (audio.write > audio.user_samples + audio.user_safe_size) {
-                audio.write = audio.user_samples;
-                audio.wrapped = true;
-            }
         }
 
 
@@ -446,6 +608,10 @@ int main()
         }
     }
 
+    audio_mixer.quit = true;
+    SDL_SemPost(audio_mixer.wake);
+    SDL_WaitThread(audio_mixer.thread, NULL);
+
     SDL_CloseAudioDevice(audio_device);
     SDL_DestroyWindow(window);
     SDL_Quit();
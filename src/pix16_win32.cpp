@@ -68,6 +68,9 @@ struct Win32_Framebuffer
     i32 height;
     i32 bytes_per_pixel;
     u32 *pixels;
+
+    // NOTE(nick): the 8-bit screen for palette mode, expanded into pixels before presenting
+    u8 *indices;
     
     BITMAPINFO bitmap_info;
     HBITMAP bitmap;
@@ -162,12 +165,18 @@ win32_resize_framebuffer(Win32_Framebuffer *it, int width, int height)
         VirtualFree(it->pixels, 0, MEM_RELEASE);
     }
 
+    if (it->indices)
+    {
+        VirtualFree(it->indices, 0, MEM_RELEASE);
+    }
+
     it->width = width;
     it->height = height;
     it->bytes_per_pixel = 4;
 
     i64 size = (it->width * it->height) * it->bytes_per_pixel;
     it->pixels = (u32 *)VirtualAlloc(0, size, MEM_COMMIT, PAGE_READWRITE);
+    it->indices = (u8 *)VirtualAlloc(0, it->width * it->height, MEM_COMMIT, PAGE_READWRITE);
 
     return true;
 }
@@ -679,6 +688,7 @@ int APIENTRY WinMain(HINSTANCE instance, HINSTANCE prev_inst, LPSTR argv, int ar
 
         static Game_Output output = {};
         output.pixels = win32_framebuffer.pixels;
+        output.indices = win32_framebuffer.indices;
         output.width  = win32_framebuffer.width;
         output.height = win32_framebuffer.height;
 
@@ -710,6 +720,30 @@ int APIENTRY WinMain(HINSTANCE instance, HINSTANCE prev_inst, LPSTR argv, int ar
 
         GameSetState(&input, &output, &prev_input);
         GameUpdateAndRender(&input, &output);
+        GameEndFrame();
+
+        // NOTE(nick): the whole framebuffer gets presented, so only the pixels that changed need expanding
+        if (output.palette_mode)
+        {
+            Win32_Framebuffer *framebuffer = &win32_framebuffer;
+
+            if (output.palette_changed)
+            {
+                simd_palette_expand(framebuffer->pixels, framebuffer->indices, framebuffer->width * framebuffer->height, output.palette);
+            }
+            else
+            {
+                for (i32 i = 0; i < output.dirty_rect_count; i += 1)
+                {
+                    Rectangle2i it = output.dirty_rects[i];
+                    for (i32 y = it.y0; y < it.y1; y += 1)
+                    {
+                        i64 offset = (i64)y * framebuffer->width + it.x0;
+                        simd_palette_expand(framebuffer->pixels + offset, framebuffer->indices + offset, r2i_width(it), output.palette);
+                    }
+                }
+            }
+        }
 
         profiler__end();
         profiler__print();
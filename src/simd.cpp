@@ -0,0 +1,1662 @@
+#pragma once
+
+//
+// NOTE(nick): SIMD kernels with runtime CPU dispatch
+//
+// The platform builds don't pass any -m flags, so every kernel that needs more
+// than the baseline instruction set is compiled with a per-function target
+// attribute and is only ever called after simd_init() has checked that the CPU
+// (and the OS, for AVX state) supports it.
+//
+
+#if ARCH_X64 || ARCH_X86
+    #define SIMD_X86 1
+    #if COMPILER_MSVC
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+    #include <immintrin.h>
+#elif ARCH_ARM64
+    #define SIMD_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#ifndef SIMD_X86
+    #define SIMD_X86 0
+#endif
+#ifndef SIMD_NEON
+    #define SIMD_NEON 0
+#endif
+
+#if COMPILER_MSVC
+    #define SIMD_TARGET_SSE2
+    #define SIMD_TARGET_AVX2
+#else
+    #define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+    #define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+typedef u32 CPU_Features;
+enum
+{
+    CPU_SSE2 = (1 << 0),
+    CPU_AVX2 = (1 << 1),
+    CPU_NEON = (1 << 2),
+};
+
+// NOTE(nick): sources are always premultiplied RGBA8, destinations are the framebuffer
+typedef u32 Blend_Op;
+enum
+{
+    BlendOp_Copy = 0,  // d = s
+    BlendOp_Over,      // d = s + d * (1 - sa)
+    BlendOp_Add,       // d = s + d
+    BlendOp_Multiply,  // d = d * (s + 1 - sa)
+
+    BlendOp_COUNT,
+};
+
+typedef void Fill_U32_Proc(u32 *dest, u32 value, i64 count);
+typedef void Blend_Proc(u32 *dest, u32 *src, i64 count);
+typedef void Tint_Proc(u32 *dest, u32 *src, i64 count, u32 tint);
+typedef void Palette_Expand_Proc(u32 *dest, u8 *src, i64 count, u32 *palette);
+typedef void Copy_Keyed_U8_Proc(u8 *dest, u8 *src, i64 count);
+typedef void Gradient_Proc(u32 *dest, i64 count, i32 *start, i32 *step);
+typedef void Mix_I16_Proc(f32 *dest, i16 *src, i64 count, f32 gain);
+typedef f32  Mix_Peak_Proc(f32 *src, i64 count);
+typedef void Mix_Output_Proc(i16 *dest, f32 *src, i64 frame_count, f32 gain, f32 gain_step);
+
+struct Simd_Kernels
+{
+    CPU_Features features;
+
+    // NOTE(nick): regular stores, result stays in cache
+    Fill_U32_Proc *fill_u32;
+
+    // NOTE(nick): non-temporal stores, for buffers much bigger than the cache
+    Fill_U32_Proc *fill_u32_stream;
+
+    Blend_Proc *blend[BlendOp_COUNT];
+
+    Tint_Proc *tint;
+
+    Palette_Expand_Proc *palette_expand;
+    Copy_Keyed_U8_Proc *copy_keyed_u8;
+
+    Gradient_Proc *gradient;
+
+    Mix_I16_Proc *mix_i16;
+    Mix_Peak_Proc *mix_peak;
+    Mix_Output_Proc *mix_output;
+};
+
+static Simd_Kernels g_simd = {0};
+
+//
+// CPU Detection
+//
+
+function CPU_Features simd__detect_cpu_features()
+{
+    CPU_Features result = 0;
+
+    #if SIMD_X86
+        u32 regs[4] = {0};
+        u32 max_leaf = 0;
+
+        #if COMPILER_MSVC
+            __cpuid((int *)regs, 0);
+            max_leaf = regs[0];
+        #else
+            __get_cpuid(0, &regs[0], &regs[1], &regs[2], &regs[3]);
+            max_leaf = regs[0];
+        #endif
+
+        if (max_leaf >= 1)
+        {
+            #if COMPILER_MSVC
+                __cpuid((int *)regs, 1);
+            #else
+                __get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+            #endif
+
+            u32 ecx = regs[2];
+            u32 edx = regs[3];
+
+            if (edx & (1 << 26)) result |= CPU_SSE2;
+
+            b32 has_osxsave = (ecx & (1 << 27)) != 0;
+            b32 has_avx     = (ecx & (1 << 28)) != 0;
+
+            // NOTE(nick): the OS also has to save the YMM registers on context switches
+            b32 os_saves_ymm = false;
+            if (has_osxsave && has_avx)
+            {
+                #if COMPILER_MSVC
+                    u64 xcr0 = _xgetbv(0);
+                #else
+                    u32 xcr0_lo, xcr0_hi;
+                    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+                    u64 xcr0 = ((u64)xcr0_hi << 32) | xcr0_lo;
+                #endif
+
+                os_saves_ymm = (xcr0 & 0x6) == 0x6;
+            }
+
+            if (os_saves_ymm && max_leaf >= 7)
+            {
+                #if COMPILER_MSVC
+                    __cpuidex((int *)regs, 7, 0);
+                #else
+                    __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+                #endif
+
+                u32 ebx = regs[1];
+                if (ebx & (1 << 5)) result |= CPU_AVX2;
+            }
+        }
+    #endif
+
+    #if SIMD_NEON
+        // NOTE(nick): NEON (ASIMD) is mandatory on AArch64
+        result |= CPU_NEON;
+    #endif
+
+    return result;
+}
+
+//
+// Fill
+//
+
+function void simd__fill_u32_scalar(u32 *dest, u32 value, i64 count)
+{
+    for (i64 index = 0; index < count; index += 1)
+    {
+        dest[index] = value;
+    }
+}
+
+#if SIMD_X86
+
+SIMD_TARGET_SSE2
+function void simd__fill_u32_sse2(u32 *dest, u32 value, i64 count)
+{
+    while (count > 0 && ((u64)dest & 15) != 0)
+    {
+        *dest++ = value;
+        count -= 1;
+    }
+
+    __m128i v = _mm_set1_epi32((int)value);
+
+    while (count >= 16)
+    {
+        _mm_store_si128((__m128i *)(dest + 0),  v);
+        _mm_store_si128((__m128i *)(dest + 4),  v);
+        _mm_store_si128((__m128i *)(dest + 8),  v);
+        _mm_store_si128((__m128i *)(dest + 12), v);
+        dest  += 16;
+        count -= 16;
+    }
+
+    while (count >= 4)
+    {
+        _mm_store_si128((__m128i *)dest, v);
+        dest  += 4;
+        count -= 4;
+    }
+
+    while (count > 0)
+    {
+        *dest++ = value;
+        count -= 1;
+    }
+}
+
+SIMD_TARGET_SSE2
+function void simd__fill_u32_stream_sse2(u32 *dest, u32 value, i64 count)
+{
+    while (count > 0 && ((u64)dest & 15) != 0)
+    {
+        *dest++ = value;
+        count -= 1;
+    }
+
+    __m128i v = _mm_set1_epi32((int)value);
+
+    while (count >= 16)
+    {
+        _mm_stream_si128((__m128i *)(dest + 0),  v);
+        _mm_stream_si128((__m128i *)(dest + 4),  v);
+        _mm_stream_si128((__m128i *)(dest + 8),  v);
+        _mm_stream_si128((__m128i *)(dest + 12), v);
+        dest  += 16;
+        count -= 16;
+    }
+
+    while (count >= 4)
+    {
+        _mm_stream_si128((__m128i *)dest, v);
+        dest  += 4;
+        count -= 4;
+    }
+
+    _mm_sfence();
+
+    while (count > 0)
+    {
+        *dest++ = value;
+        count -= 1;
+    }
+}
+
+SIMD_TARGET_AVX2
+function void simd__fill_u32_avx2(u32 *dest, u32 value, i64 count)
+{
+    while (count > 0 && ((u64)dest & 31) != 0)
+    {
+        *dest++ = value;
+        count -= 1;
+    }
+
+    __m256i v = _mm256_set1_epi32((int)value);
+
+    while (count >= 32)
+    {
+        _mm256_store_si256((__m256i *)(dest + 0),  v);
+        _mm256_store_si256((__m256i *)(dest + 8),  v);
+        _mm256_store_si256((__m256i *)(dest + 16), v);
+        _mm256_store_si256((__m256i *)(dest + 24), v);
+        dest  += 32;
+        count -= 32;
+    }
+
+    while (count >= 8)
+    {
+        _mm256_store_si256((__m256i *)dest, v);
+        dest  += 8;
+        count -= 8;
+    }
+
+    while (count > 0)
+    {
+        *dest++ = value;
+        count -= 1;
+    }
+}
+
+SIMD_TARGET_AVX2
+function void simd__fill_u32_stream_avx2(u32 *dest, u32 value, i64 count)
+{
+    while (count > 0 && ((u64)dest & 31) != 0)
+    {
+        *dest++ = value;
+        count -= 1;
+    }
+
+    __m256i v = _mm256_set1_epi32((int)value);
+
+    while (count >= 32)
+    {
+        _mm256_stream_si256((__m256i *)(dest + 0),  v);
+        _mm256_stream_si256((__m256i *)(dest + 8),  v);
+        _mm256_stream_si256((__m256i *)(dest + 16), v);
+        _mm256_stream_si256((__m256i *)(dest + 24), v);
+        dest  += 32;
+        count -= 32;
+    }
+
+    while (count >= 8)
+    {
+        _mm256_stream_si256((__m256i *)dest, v);
+        dest  += 8;
+        count -= 8;
+    }
+
+    _mm_sfence();
+
+    while (count > 0)
+    {
+        *dest++ = value;
+        count -= 1;
+    }
+}
+
+#endif // SIMD_X86
+
+#if SIMD_NEON
+
+function void simd__fill_u32_neon(u32 *dest, u32 value, i64 count)
+{
+    uint32x4_t v = vdupq_n_u32(value);
+
+    while (count >= 16)
+    {
+        vst1q_u32(dest + 0,  v);
+        vst1q_u32(dest + 4,  v);
+        vst1q_u32(dest + 8,  v);
+        vst1q_u32(dest + 12, v);
+        dest  += 16;
+        count -= 16;
+    }
+
+    while (count >= 4)
+    {
+        vst1q_u32(dest, v);
+        dest  += 4;
+        count -= 4;
+    }
+
+    while (count > 0)
+    {
+        *dest++ = value;
+        count -= 1;
+    }
+}
+
+#endif // SIMD_NEON
+
+//
+// Blend
+//
+
+function u32 simd__div255(u32 x)
+{
+    // NOTE(nick): exact round(x / 255) for x in [0, 255*255]
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+function void simd__blend_copy(u32 *dest, u32 *src, i64 count)
+{
+    MemoryCopy(dest, src, count * sizeof(u32));
+}
+
+// NOTE(nick): two channels per 16-bit lane, same rounding as simd__div255
+function u32 simd__over_pixel(u32 d, u32 s)
+{
+    u32 sa = s >> 24;
+    if (sa == 0xff) return s;
+    if (s == 0) return d;
+
+    u32 inv = 255 - sa;
+    u32 rb = (d & 0x00ff00ff) * inv + 0x00800080;
+    u32 ag = ((d >> 8) & 0x00ff00ff) * inv + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    ag = ((ag + ((ag >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+
+    rb += s & 0x00ff00ff;
+    ag += (s >> 8) & 0x00ff00ff;
+    rb = (rb | (((rb >> 8) & 0x00010001) * 0xff)) & 0x00ff00ff;
+    ag = (ag | (((ag >> 8) & 0x00010001) * 0xff)) & 0x00ff00ff;
+
+    return rb | (ag << 8);
+}
+
+function void simd__blend_over_scalar(u32 *dest, u32 *src, i64 count)
+{
+    for (i64 index = 0; index < count; index += 1)
+    {
+        dest[index] = simd__over_pixel(dest[index], src[index]);
+    }
+}
+
+function void simd__blend_add_scalar(u32 *dest, u32 *src, i64 count)
+{
+    for (i64 index = 0; index < count; index += 1)
+    {
+        u32 s = src[index];
+        u32 d = dest[index];
+        u32 result = 0;
+        for (u32 shift = 0; shift < 32; shift += 8)
+        {
+            u32 c = ((s >> shift) & 0xff) + ((d >> shift) & 0xff);
+            result |= Min(c, 255) << shift;
+        }
+        dest[index] = result;
+    }
+}
+
+function void simd__blend_multiply_scalar(u32 *dest, u32 *src, i64 count)
+{
+    for (i64 index = 0; index < count; index += 1)
+    {
+        u32 s = src[index];
+        u32 d = dest[index];
+        u32 sa = s >> 24;
+        u32 result = 0;
+        for (u32 shift = 0; shift < 32; shift += 8)
+        {
+            u32 f = ((s >> shift) & 0xff) + (255 - sa);
+            u32 c = simd__div255(((d >> shift) & 0xff) * f);
+            result |= c << shift;
+        }
+        dest[index] = result;
+    }
+}
+
+#if SIMD_X86
+
+// NOTE(nick): 16-bit lanes, round(x / 255)
+#define simd__div255_epi16(x) _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16((x), c128), _mm_srli_epi16(_mm_add_epi16((x), c128), 8)), 8)
+#define simd__div255_epi16_avx2(x) _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16((x), c128), _mm256_srli_epi16(_mm256_add_epi16((x), c128), 8)), 8)
+
+#define SIMD_SPLAT_ALPHA _MM_SHUFFLE(3, 3, 3, 3)
+
+SIMD_TARGET_SSE2
+function void simd__blend_over_sse2(u32 *dest, u32 *src, i64 count)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i c128 = _mm_set1_epi16(128);
+    __m128i c255 = _mm_set1_epi16(255);
+    __m128i alpha_mask = _mm_set1_epi32((int)0xff000000);
+
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128i s = _mm_loadu_si128((__m128i *)(src + index));
+        __m128i sa = _mm_and_si128(s, alpha_mask);
+
+        // NOTE(nick): most sprite pixels are either fully transparent or fully opaque
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff) continue;
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, alpha_mask)) == 0xffff)
+        {
+            _mm_storeu_si128((__m128i *)(dest + index), s);
+            continue;
+        }
+
+        __m128i d = _mm_loadu_si128((__m128i *)(dest + index));
+
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+        __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+
+        __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, SIMD_SPLAT_ALPHA), SIMD_SPLAT_ALPHA);
+        __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, SIMD_SPLAT_ALPHA), SIMD_SPLAT_ALPHA);
+
+        __m128i t_lo = _mm_mullo_epi16(d_lo, _mm_sub_epi16(c255, a_lo));
+        __m128i t_hi = _mm_mullo_epi16(d_hi, _mm_sub_epi16(c255, a_hi));
+
+        t_lo = simd__div255_epi16(t_lo);
+        t_hi = simd__div255_epi16(t_hi);
+
+        __m128i result = _mm_adds_epu8(s, _mm_packus_epi16(t_lo, t_hi));
+        _mm_storeu_si128((__m128i *)(dest + index), result);
+    }
+
+    simd__blend_over_scalar(dest + index, src + index, count - index);
+}
+
+SIMD_TARGET_SSE2
+function void simd__blend_add_sse2(u32 *dest, u32 *src, i64 count)
+{
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128i s = _mm_loadu_si128((__m128i *)(src + index));
+        __m128i d = _mm_loadu_si128((__m128i *)(dest + index));
+        _mm_storeu_si128((__m128i *)(dest + index), _mm_adds_epu8(s, d));
+    }
+
+    simd__blend_add_scalar(dest + index, src + index, count - index);
+}
+
+SIMD_TARGET_SSE2
+function void simd__blend_multiply_sse2(u32 *dest, u32 *src, i64 count)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i c128 = _mm_set1_epi16(128);
+    __m128i c255 = _mm_set1_epi16(255);
+
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128i s = _mm_loadu_si128((__m128i *)(src + index));
+        __m128i d = _mm_loadu_si128((__m128i *)(dest + index));
+
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+        __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+
+        __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, SIMD_SPLAT_ALPHA), SIMD_SPLAT_ALPHA);
+        __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, SIMD_SPLAT_ALPHA), SIMD_SPLAT_ALPHA);
+
+        __m128i f_lo = _mm_add_epi16(s_lo, _mm_sub_epi16(c255, a_lo));
+        __m128i f_hi = _mm_add_epi16(s_hi, _mm_sub_epi16(c255, a_hi));
+
+        __m128i t_lo = simd__div255_epi16(_mm_mullo_epi16(d_lo, f_lo));
+        __m128i t_hi = simd__div255_epi16(_mm_mullo_epi16(d_hi, f_hi));
+
+        _mm_storeu_si128((__m128i *)(dest + index), _mm_packus_epi16(t_lo, t_hi));
+    }
+
+    simd__blend_multiply_scalar(dest + index, src + index, count - index);
+}
+
+SIMD_TARGET_AVX2
+function void simd__blend_over_avx2(u32 *dest, u32 *src, i64 count)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i c128 = _mm256_set1_epi16(128);
+    __m256i c255 = _mm256_set1_epi16(255);
+    __m256i alpha_mask = _mm256_set1_epi32((int)0xff000000);
+
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        __m256i s = _mm256_loadu_si256((__m256i *)(src + index));
+        __m256i sa = _mm256_and_si256(s, alpha_mask);
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) == -1) continue;
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, alpha_mask)) == -1)
+        {
+            _mm256_storeu_si256((__m256i *)(dest + index), s);
+            continue;
+        }
+
+        __m256i d = _mm256_loadu_si256((__m256i *)(dest + index));
+
+        __m256i s_lo = _mm256_unpacklo_epi8(s, zero);
+        __m256i s_hi = _mm256_unpackhi_epi8(s, zero);
+        __m256i d_lo = _mm256_unpacklo_epi8(d, zero);
+        __m256i d_hi = _mm256_unpackhi_epi8(d, zero);
+
+        __m256i a_lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_lo, SIMD_SPLAT_ALPHA), SIMD_SPLAT_ALPHA);
+        __m256i a_hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_hi, SIMD_SPLAT_ALPHA), SIMD_SPLAT_ALPHA);
+
+        __m256i t_lo = _mm256_mullo_epi16(d_lo, _mm256_sub_epi16(c255, a_lo));
+        __m256i t_hi = _mm256_mullo_epi16(d_hi, _mm256_sub_epi16(c255, a_hi));
+
+        t_lo = simd__div255_epi16_avx2(t_lo);
+        t_hi = simd__div255_epi16_avx2(t_hi);
+
+        __m256i result = _mm256_adds_epu8(s, _mm256_packus_epi16(t_lo, t_hi));
+        _mm256_storeu_si256((__m256i *)(dest + index), result);
+    }
+
+    // NOTE(nick): the tail is SSE2, clear the upper halves so it doesn't pay for the transition
+    _mm256_zeroupper();
+    simd__blend_over_sse2(dest + index, src + index, count - index);
+}
+
+SIMD_TARGET_AVX2
+function void simd__blend_add_avx2(u32 *dest, u32 *src, i64 count)
+{
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        __m256i s = _mm256_loadu_si256((__m256i *)(src + index));
+        __m256i d = _mm256_loadu_si256((__m256i *)(dest + index));
+        _mm256_storeu_si256((__m256i *)(dest + index), _mm256_adds_epu8(s, d));
+    }
+
+    _mm256_zeroupper();
+    simd__blend_add_sse2(dest + index, src + index, count - index);
+}
+
+SIMD_TARGET_AVX2
+function void simd__blend_multiply_avx2(u32 *dest, u32 *src, i64 count)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i c128 = _mm256_set1_epi16(128);
+    __m256i c255 = _mm256_set1_epi16(255);
+
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        __m256i s = _mm256_loadu_si256((__m256i *)(src + index));
+        __m256i d = _mm256_loadu_si256((__m256i *)(dest + index));
+
+        __m256i s_lo = _mm256_unpacklo_epi8(s, zero);
+        __m256i s_hi = _mm256_unpackhi_epi8(s, zero);
+        __m256i d_lo = _mm256_unpacklo_epi8(d, zero);
+        __m256i d_hi = _mm256_unpackhi_epi8(d, zero);
+
+        __m256i a_lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_lo, SIMD_SPLAT_ALPHA), SIMD_SPLAT_ALPHA);
+        __m256i a_hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_hi, SIMD_SPLAT_ALPHA), SIMD_SPLAT_ALPHA);
+
+        __m256i f_lo = _mm256_add_epi16(s_lo, _mm256_sub_epi16(c255, a_lo));
+        __m256i f_hi = _mm256_add_epi16(s_hi, _mm256_sub_epi16(c255, a_hi));
+
+        __m256i t_lo = simd__div255_epi16_avx2(_mm256_mullo_epi16(d_lo, f_lo));
+        __m256i t_hi = simd__div255_epi16_avx2(_mm256_mullo_epi16(d_hi, f_hi));
+
+        _mm256_storeu_si256((__m256i *)(dest + index), _mm256_packus_epi16(t_lo, t_hi));
+    }
+
+    _mm256_zeroupper();
+    simd__blend_multiply_sse2(dest + index, src + index, count - index);
+}
+
+#endif // SIMD_X86
+
+#if SIMD_NEON
+
+// NOTE(nick): 8-bit lanes, round(x / 255) of a 16-bit product
+#define simd__div255_u16_neon(x) vraddhn_u16((x), vrshrq_n_u16((x), 8))
+
+function void simd__blend_over_neon(u32 *dest, u32 *src, i64 count)
+{
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        uint8x8x4_t s = vld4_u8((u8 *)(src + index));
+        uint8x8x4_t d = vld4_u8((u8 *)(dest + index));
+
+        uint8x8_t inv_a = vmvn_u8(s.val[3]);
+        for (int c = 0; c < 4; c += 1)
+        {
+            uint16x8_t t = vmull_u8(d.val[c], inv_a);
+            d.val[c] = vqadd_u8(s.val[c], simd__div255_u16_neon(t));
+        }
+
+        vst4_u8((u8 *)(dest + index), d);
+    }
+
+    simd__blend_over_scalar(dest + index, src + index, count - index);
+}
+
+function void simd__blend_add_neon(u32 *dest, u32 *src, i64 count)
+{
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        uint8x16_t s = vld1q_u8((u8 *)(src + index));
+        uint8x16_t d = vld1q_u8((u8 *)(dest + index));
+        vst1q_u8((u8 *)(dest + index), vqaddq_u8(s, d));
+    }
+
+    simd__blend_add_scalar(dest + index, src + index, count - index);
+}
+
+function void simd__blend_multiply_neon(u32 *dest, u32 *src, i64 count)
+{
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        uint8x8x4_t s = vld4_u8((u8 *)(src + index));
+        uint8x8x4_t d = vld4_u8((u8 *)(dest + index));
+
+        uint8x8_t inv_a = vmvn_u8(s.val[3]);
+        for (int c = 0; c < 4; c += 1)
+        {
+            uint16x8_t t = vmull_u8(d.val[c], vadd_u8(s.val[c], inv_a));
+            d.val[c] = simd__div255_u16_neon(t);
+        }
+
+        vst4_u8((u8 *)(dest + index), d);
+    }
+
+    simd__blend_multiply_scalar(dest + index, src + index, count - index);
+}
+
+#endif // SIMD_NEON
+
+//
+// Tint
+//
+// NOTE(nick): d = s * tint per channel, rounded the same way as the blend kernels
+//
+
+function u32 simd_tint_pixel(u32 s, u32 tint)
+{
+    u32 result = 0;
+    for (u32 shift = 0; shift < 32; shift += 8)
+    {
+        u32 c = ((s >> shift) & 0xff) * ((tint >> shift) & 0xff);
+        result |= simd__div255(c) << shift;
+    }
+    return result;
+}
+
+function void simd__tint_scalar(u32 *dest, u32 *src, i64 count, u32 tint)
+{
+    for (i64 index = 0; index < count; index += 1)
+    {
+        dest[index] = simd_tint_pixel(src[index], tint);
+    }
+}
+
+#if SIMD_X86
+
+SIMD_TARGET_SSE2
+function void simd__tint_sse2(u32 *dest, u32 *src, i64 count, u32 tint)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i c128 = _mm_set1_epi16(128);
+    __m128i t = _mm_unpacklo_epi8(_mm_set1_epi32((int)tint), zero);
+
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128i s = _mm_loadu_si128((__m128i *)(src + index));
+
+        __m128i s_lo = simd__div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), t));
+        __m128i s_hi = simd__div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), t));
+
+        _mm_storeu_si128((__m128i *)(dest + index), _mm_packus_epi16(s_lo, s_hi));
+    }
+
+    simd__tint_scalar(dest + index, src + index, count - index, tint);
+}
+
+SIMD_TARGET_AVX2
+function void simd__tint_avx2(u32 *dest, u32 *src, i64 count, u32 tint)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i c128 = _mm256_set1_epi16(128);
+    __m256i t = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)tint), zero);
+
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        __m256i s = _mm256_loadu_si256((__m256i *)(src + index));
+
+        __m256i s_lo = simd__div255_epi16_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), t));
+        __m256i s_hi = simd__div255_epi16_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), t));
+
+        _mm256_storeu_si256((__m256i *)(dest + index), _mm256_packus_epi16(s_lo, s_hi));
+    }
+
+    _mm256_zeroupper();
+    simd__tint_sse2(dest + index, src + index, count - index, tint);
+}
+
+#endif // SIMD_X86
+
+#if SIMD_NEON
+
+function void simd__tint_neon(u32 *dest, u32 *src, i64 count, u32 tint)
+{
+    uint8x8_t t[4];
+    for (int c = 0; c < 4; c += 1)
+    {
+        t[c] = vdup_n_u8((u8)(tint >> (c * 8)));
+    }
+
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        uint8x8x4_t s = vld4_u8((u8 *)(src + index));
+
+        for (int c = 0; c < 4; c += 1)
+        {
+            s.val[c] = simd__div255_u16_neon(vmull_u8(s.val[c], t[c]));
+        }
+
+        vst4_u8((u8 *)(dest + index), s);
+    }
+
+    simd__tint_scalar(dest + index, src + index, count - index, tint);
+}
+
+#endif // SIMD_NEON
+
+//
+// Palette
+//
+// NOTE(nick): 8-bit indexed pixels, expanded through a 256 entry table or copied with index 0 as
+// the transparent color key
+//
+
+function void simd__palette_expand_scalar(u32 *dest, u8 *src, i64 count, u32 *palette)
+{
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        dest[index + 0] = palette[src[index + 0]];
+        dest[index + 1] = palette[src[index + 1]];
+        dest[index + 2] = palette[src[index + 2]];
+        dest[index + 3] = palette[src[index + 3]];
+    }
+
+    for (; index < count; index += 1)
+    {
+        dest[index] = palette[src[index]];
+    }
+}
+
+function void simd__copy_keyed_u8_scalar(u8 *dest, u8 *src, i64 count)
+{
+    for (i64 index = 0; index < count; index += 1)
+    {
+        if (src[index]) dest[index] = src[index];
+    }
+}
+
+#if SIMD_X86
+
+SIMD_TARGET_SSE2
+function void simd__copy_keyed_u8_sse2(u8 *dest, u8 *src, i64 count)
+{
+    __m128i zero = _mm_setzero_si128();
+
+    i64 index = 0;
+    for (; index + 16 <= count; index += 16)
+    {
+        __m128i s = _mm_loadu_si128((__m128i *)(src + index));
+        __m128i d = _mm_loadu_si128((__m128i *)(dest + index));
+        __m128i keep = _mm_cmpeq_epi8(s, zero);
+
+        _mm_storeu_si128((__m128i *)(dest + index), _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s)));
+    }
+
+    simd__copy_keyed_u8_scalar(dest + index, src + index, count - index);
+}
+
+// NOTE(nick): the table is 1KB so it stays in L1, the gathers just save the scalar loads and inserts
+SIMD_TARGET_AVX2
+function void simd__palette_expand_avx2(u32 *dest, u8 *src, i64 count, u32 *palette)
+{
+    i64 index = 0;
+    for (; index + 16 <= count; index += 16)
+    {
+        __m128i indices = _mm_loadu_si128((__m128i *)(src + index));
+        __m256i lo = _mm256_cvtepu8_epi32(indices);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(indices, 8));
+
+        _mm256_storeu_si256((__m256i *)(dest + index + 0), _mm256_i32gather_epi32((int *)palette, lo, 4));
+        _mm256_storeu_si256((__m256i *)(dest + index + 8), _mm256_i32gather_epi32((int *)palette, hi, 4));
+    }
+
+    _mm256_zeroupper();
+    simd__palette_expand_scalar(dest + index, src + index, count - index, palette);
+}
+
+SIMD_TARGET_AVX2
+function void simd__copy_keyed_u8_avx2(u8 *dest, u8 *src, i64 count)
+{
+    __m256i zero = _mm256_setzero_si256();
+
+    i64 index = 0;
+    for (; index + 32 <= count; index += 32)
+    {
+        __m256i s = _mm256_loadu_si256((__m256i *)(src + index));
+        __m256i d = _mm256_loadu_si256((__m256i *)(dest + index));
+        __m256i keep = _mm256_cmpeq_epi8(s, zero);
+
+        _mm256_storeu_si256((__m256i *)(dest + index), _mm256_blendv_epi8(s, d, keep));
+    }
+
+    _mm256_zeroupper();
+    simd__copy_keyed_u8_sse2(dest + index, src + index, count - index);
+}
+
+#endif // SIMD_X86
+
+#if SIMD_NEON
+
+function void simd__copy_keyed_u8_neon(u8 *dest, u8 *src, i64 count)
+{
+    i64 index = 0;
+    for (; index + 16 <= count; index += 16)
+    {
+        uint8x16_t s = vld1q_u8(src + index);
+        uint8x16_t d = vld1q_u8(dest + index);
+        uint8x16_t keep = vceqq_u8(s, vdupq_n_u8(0));
+
+        vst1q_u8(dest + index, vbslq_u8(keep, d, s));
+    }
+
+    simd__copy_keyed_u8_scalar(dest + index, src + index, count - index);
+}
+
+#endif // SIMD_NEON
+
+//
+// Gradients
+//
+// NOTE(nick): start and step hold the 4 channels in 16.16 fixed point, pixel i gets
+// start + step * i with the fraction dropped and clamped to 0..255
+//
+
+function void simd__gradient_scalar(u32 *dest, i64 count, i32 *start, i32 *step)
+{
+    i32 c[4] = {start[0], start[1], start[2], start[3]};
+
+    for (i64 index = 0; index < count; index += 1)
+    {
+        u32 result = 0;
+        for (int i = 0; i < 4; i += 1)
+        {
+            result |= (u32)Clamp(c[i] >> 16, 0, 255) << (8 * i);
+            c[i] += step[i];
+        }
+        dest[index] = result;
+    }
+}
+
+#if SIMD_X86
+
+SIMD_TARGET_SSE2
+function void simd__gradient_sse2(u32 *dest, i64 count, i32 *start, i32 *step)
+{
+    // NOTE(nick): one pixel per register, the saturating packs do the clamping
+    __m128i d  = _mm_loadu_si128((__m128i *)step);
+    __m128i p0 = _mm_loadu_si128((__m128i *)start);
+    __m128i p1 = _mm_add_epi32(p0, d);
+    __m128i p2 = _mm_add_epi32(p1, d);
+    __m128i p3 = _mm_add_epi32(p2, d);
+    __m128i d4 = _mm_slli_epi32(d, 2);
+
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128i lo = _mm_packs_epi32(_mm_srai_epi32(p0, 16), _mm_srai_epi32(p1, 16));
+        __m128i hi = _mm_packs_epi32(_mm_srai_epi32(p2, 16), _mm_srai_epi32(p3, 16));
+
+        _mm_storeu_si128((__m128i *)(dest + index), _mm_packus_epi16(lo, hi));
+
+        p0 = _mm_add_epi32(p0, d4);
+        p1 = _mm_add_epi32(p1, d4);
+        p2 = _mm_add_epi32(p2, d4);
+        p3 = _mm_add_epi32(p3, d4);
+    }
+
+    i32 rest[4];
+    _mm_storeu_si128((__m128i *)rest, p0);
+    simd__gradient_scalar(dest + index, count - index, rest, step);
+}
+
+#endif // SIMD_X86
+
+#if SIMD_NEON
+
+function void simd__gradient_neon(u32 *dest, i64 count, i32 *start, i32 *step)
+{
+    int32x4_t d  = vld1q_s32(step);
+    int32x4_t p0 = vld1q_s32(start);
+    int32x4_t p1 = vaddq_s32(p0, d);
+    int32x4_t p2 = vaddq_s32(p1, d);
+    int32x4_t p3 = vaddq_s32(p2, d);
+    int32x4_t d4 = vshlq_n_s32(d, 2);
+
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        int16x8_t lo = vcombine_s16(vqmovn_s32(vshrq_n_s32(p0, 16)), vqmovn_s32(vshrq_n_s32(p1, 16)));
+        int16x8_t hi = vcombine_s16(vqmovn_s32(vshrq_n_s32(p2, 16)), vqmovn_s32(vshrq_n_s32(p3, 16)));
+
+        vst1q_u8((u8 *)(dest + index), vcombine_u8(vqmovun_s16(lo), vqmovun_s16(hi)));
+
+        p0 = vaddq_s32(p0, d4);
+        p1 = vaddq_s32(p1, d4);
+        p2 = vaddq_s32(p2, d4);
+        p3 = vaddq_s32(p3, d4);
+    }
+
+    i32 rest[4];
+    vst1q_s32(rest, p0);
+    simd__gradient_scalar(dest + index, count - index, rest, step);
+}
+
+#endif // SIMD_NEON
+
+//
+// Audio
+//
+// NOTE(nick): the mix bus is interleaved stereo f32 in i16 units, so the output stage is just a
+// gain, a clamp and a truncating conversion (same as an (i16) cast of the clamped value)
+//
+
+function void simd__mix_i16_scalar(f32 *dest, i16 *src, i64 count, f32 gain)
+{
+    for (i64 index = 0; index < count; index += 1)
+    {
+        dest[index] += (f32)src[index] * gain;
+    }
+}
+
+function f32 simd__mix_peak_scalar(f32 *src, i64 count)
+{
+    f32 result = 0;
+    for (i64 index = 0; index < count; index += 1)
+    {
+        f32 it = src[index] < 0 ? -src[index] : src[index];
+        if (it > result) result = it;
+    }
+    return result;
+}
+
+// NOTE(nick): frame i (both channels) is scaled by gain + gain_step * i
+function void simd__mix_output_scalar(i16 *dest, f32 *src, i64 frame_count, f32 gain, f32 gain_step)
+{
+    for (i64 index = 0; index < frame_count; index += 1)
+    {
+        f32 g = gain + gain_step * (f32)index;
+        for (int c = 0; c < 2; c += 1)
+        {
+            f32 it = Clamp(src[2 * index + c] * g, (f32)I16_MIN, (f32)I16_MAX);
+            dest[2 * index + c] = (i16)(i32)it;
+        }
+    }
+}
+
+#if SIMD_X86
+
+SIMD_TARGET_SSE2
+function void simd__mix_i16_sse2(f32 *dest, i16 *src, i64 count, f32 gain)
+{
+    __m128 g = _mm_set1_ps(gain);
+
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        __m128i s = _mm_loadu_si128((__m128i *)(src + index));
+
+        // NOTE(nick): the i16 lands in the high half, the arithmetic shift sign extends it
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+
+        _mm_storeu_ps(dest + index + 0, _mm_add_ps(_mm_loadu_ps(dest + index + 0), _mm_mul_ps(lo, g)));
+        _mm_storeu_ps(dest + index + 4, _mm_add_ps(_mm_loadu_ps(dest + index + 4), _mm_mul_ps(hi, g)));
+    }
+
+    simd__mix_i16_scalar(dest + index, src + index, count - index, gain);
+}
+
+SIMD_TARGET_SSE2
+function f32 simd__mix_peak_sse2(f32 *src, i64 count)
+{
+    __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 m = _mm_setzero_ps();
+
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(src + index), abs_mask));
+    }
+
+    f32 lanes[4];
+    _mm_storeu_ps(lanes, m);
+    f32 result = simd__mix_peak_scalar(src + index, count - index);
+    return Max(Max(result, Max(lanes[0], lanes[1])), Max(lanes[2], lanes[3]));
+}
+
+SIMD_TARGET_SSE2
+function void simd__mix_output_sse2(i16 *dest, f32 *src, i64 frame_count, f32 gain, f32 gain_step)
+{
+    __m128 lo_limit = _mm_set1_ps((f32)I16_MIN);
+    __m128 hi_limit = _mm_set1_ps((f32)I16_MAX);
+    __m128 g0 = _mm_set1_ps(gain);
+    __m128 gs = _mm_set1_ps(gain_step);
+    __m128 i0 = _mm_setr_ps(0, 0, 1, 1);
+    __m128 i1 = _mm_setr_ps(2, 2, 3, 3);
+    __m128 i4 = _mm_set1_ps(4);
+
+    i64 index = 0;
+    for (; index + 4 <= frame_count; index += 4)
+    {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + 2 * index + 0), _mm_add_ps(g0, _mm_mul_ps(gs, i0)));
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(src + 2 * index + 4), _mm_add_ps(g0, _mm_mul_ps(gs, i1)));
+
+        // NOTE(nick): clamp first, out of range floats convert to 0x80000000 whatever their sign
+        a = _mm_min_ps(_mm_max_ps(a, lo_limit), hi_limit);
+        b = _mm_min_ps(_mm_max_ps(b, lo_limit), hi_limit);
+
+        __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128((__m128i *)(dest + 2 * index), packed);
+
+        i0 = _mm_add_ps(i0, i4);
+        i1 = _mm_add_ps(i1, i4);
+    }
+
+    simd__mix_output_scalar(dest + 2 * index, src + 2 * index, frame_count - index, gain + gain_step * (f32)index, gain_step);
+}
+
+SIMD_TARGET_AVX2
+function void simd__mix_i16_avx2(f32 *dest, i16 *src, i64 count, f32 gain)
+{
+    __m256 g = _mm256_set1_ps(gain);
+
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        __m256 s = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)(src + index))));
+        _mm256_storeu_ps(dest + index, _mm256_add_ps(_mm256_loadu_ps(dest + index), _mm256_mul_ps(s, g)));
+    }
+
+    _mm256_zeroupper();
+    simd__mix_i16_scalar(dest + index, src + index, count - index, gain);
+}
+
+#endif // SIMD_X86
+
+#if SIMD_NEON
+
+function void simd__mix_i16_neon(f32 *dest, i16 *src, i64 count, f32 gain)
+{
+    float32x4_t g = vdupq_n_f32(gain);
+
+    i64 index = 0;
+    for (; index + 8 <= count; index += 8)
+    {
+        int16x8_t s = vld1q_s16(src + index);
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+
+        vst1q_f32(dest + index + 0, vaddq_f32(vld1q_f32(dest + index + 0), vmulq_f32(lo, g)));
+        vst1q_f32(dest + index + 4, vaddq_f32(vld1q_f32(dest + index + 4), vmulq_f32(hi, g)));
+    }
+
+    simd__mix_i16_scalar(dest + index, src + index, count - index, gain);
+}
+
+function f32 simd__mix_peak_neon(f32 *src, i64 count)
+{
+    float32x4_t m = vdupq_n_f32(0);
+
+    i64 index = 0;
+    for (; index + 4 <= count; index += 4)
+    {
+        m = vmaxq_f32(m, vabsq_f32(vld1q_f32(src + index)));
+    }
+
+    f32 result = simd__mix_peak_scalar(src + index, count - index);
+    return Max(result, vmaxvq_f32(m));
+}
+
+function void simd__mix_output_neon(i16 *dest, f32 *src, i64 frame_count, f32 gain, f32 gain_step)
+{
+    float32x4_t lo_limit = vdupq_n_f32((f32)I16_MIN);
+    float32x4_t hi_limit = vdupq_n_f32((f32)I16_MAX);
+    float32x4_t g0 = vdupq_n_f32(gain);
+    float32x4_t gs = vdupq_n_f32(gain_step);
+    f32 i0_init[4] = {0, 0, 1, 1};
+    f32 i1_init[4] = {2, 2, 3, 3};
+    float32x4_t i0 = vld1q_f32(i0_init);
+    float32x4_t i1 = vld1q_f32(i1_init);
+    float32x4_t i4 = vdupq_n_f32(4);
+
+    i64 index = 0;
+    for (; index + 4 <= frame_count; index += 4)
+    {
+        float32x4_t a = vmulq_f32(vld1q_f32(src + 2 * index + 0), vaddq_f32(g0, vmulq_f32(gs, i0)));
+        float32x4_t b = vmulq_f32(vld1q_f32(src + 2 * index + 4), vaddq_f32(g0, vmulq_f32(gs, i1)));
+
+        a = vminq_f32(vmaxq_f32(a, lo_limit), hi_limit);
+        b = vminq_f32(vmaxq_f32(b, lo_limit), hi_limit);
+
+        vst1q_s16(dest + 2 * index, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b))));
+
+        i0 = vaddq_f32(i0, i4);
+        i1 = vaddq_f32(i1, i4);
+    }
+
+    simd__mix_output_scalar(dest + 2 * index, src + 2 * index, frame_count - index, gain + gain_step * (f32)index, gain_step);
+}
+
+#endif // SIMD_NEON
+
+//
+// Lanes
+//
+// NOTE(nick): 4-wide helpers for kernels that are written once and compiled against the
+// baseline instruction set of each target (SSE2 is always there on x64, NEON on arm64).
+//
+
+#if ARCH_X64
+    #define SIMD_LANES_SSE2 1
+#elif SIMD_NEON
+    #define SIMD_LANES_NEON 1
+#endif
+
+#ifndef SIMD_LANES_SSE2
+    #define SIMD_LANES_SSE2 0
+#endif
+#ifndef SIMD_LANES_NEON
+    #define SIMD_LANES_NEON 0
+#endif
+
+#define LANE_WIDTH 4
+
+#if SIMD_LANES_SSE2
+    struct Lane_F32 { __m128  v; };
+    struct Lane_U32 { __m128i v; };
+#elif SIMD_LANES_NEON
+    struct Lane_F32 { float32x4_t v; };
+    struct Lane_U32 { uint32x4_t  v; };
+#else
+    struct Lane_F32 { f32 v[LANE_WIDTH]; };
+    struct Lane_U32 { u32 v[LANE_WIDTH]; };
+#endif
+
+function Lane_F32 lane_f32(f32 a, f32 b, f32 c, f32 d)
+{
+    Lane_F32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_setr_ps(a, b, c, d);
+    #elif SIMD_LANES_NEON
+        f32 values[4] = {a, b, c, d};
+        result.v = vld1q_f32(values);
+    #else
+        result.v[0] = a; result.v[1] = b; result.v[2] = c; result.v[3] = d;
+    #endif
+    return result;
+}
+
+function Lane_F32 lane_f32_set1(f32 a)
+{
+    Lane_F32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_set1_ps(a);
+    #elif SIMD_LANES_NEON
+        result.v = vdupq_n_f32(a);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = a;
+    #endif
+    return result;
+}
+
+function Lane_F32 lane_f32_load(f32 *src)
+{
+    Lane_F32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_loadu_ps(src);
+    #elif SIMD_LANES_NEON
+        result.v = vld1q_f32(src);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = src[i];
+    #endif
+    return result;
+}
+
+function void lane_f32_store(f32 *dest, Lane_F32 a)
+{
+    #if SIMD_LANES_SSE2
+        _mm_storeu_ps(dest, a.v);
+    #elif SIMD_LANES_NEON
+        vst1q_f32(dest, a.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) dest[i] = a.v[i];
+    #endif
+}
+
+function Lane_F32 operator+(Lane_F32 a, Lane_F32 b)
+{
+    Lane_F32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_add_ps(a.v, b.v);
+    #elif SIMD_LANES_NEON
+        result.v = vaddq_f32(a.v, b.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = a.v[i] + b.v[i];
+    #endif
+    return result;
+}
+
+function Lane_F32 operator-(Lane_F32 a, Lane_F32 b)
+{
+    Lane_F32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_sub_ps(a.v, b.v);
+    #elif SIMD_LANES_NEON
+        result.v = vsubq_f32(a.v, b.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = a.v[i] - b.v[i];
+    #endif
+    return result;
+}
+
+function Lane_F32 operator*(Lane_F32 a, Lane_F32 b)
+{
+    Lane_F32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_mul_ps(a.v, b.v);
+    #elif SIMD_LANES_NEON
+        result.v = vmulq_f32(a.v, b.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = a.v[i] * b.v[i];
+    #endif
+    return result;
+}
+
+function Lane_F32 &operator+=(Lane_F32 &a, Lane_F32 b)
+{
+    a = a + b;
+    return a;
+}
+
+function Lane_F32 lane_f32_min(Lane_F32 a, Lane_F32 b)
+{
+    Lane_F32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_min_ps(a.v, b.v);
+    #elif SIMD_LANES_NEON
+        result.v = vminq_f32(a.v, b.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = Min(a.v[i], b.v[i]);
+    #endif
+    return result;
+}
+
+function Lane_F32 lane_f32_max(Lane_F32 a, Lane_F32 b)
+{
+    Lane_F32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_max_ps(a.v, b.v);
+    #elif SIMD_LANES_NEON
+        result.v = vmaxq_f32(a.v, b.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = Max(a.v[i], b.v[i]);
+    #endif
+    return result;
+}
+
+// NOTE(nick): all bits set in each lane where a >= b
+function Lane_U32 lane_f32_ge(Lane_F32 a, Lane_F32 b)
+{
+    Lane_U32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_castps_si128(_mm_cmpge_ps(a.v, b.v));
+    #elif SIMD_LANES_NEON
+        result.v = vcgeq_f32(a.v, b.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = a.v[i] >= b.v[i] ? U32_MAX : 0;
+    #endif
+    return result;
+}
+
+function Lane_U32 lane_u32_set1(u32 a)
+{
+    Lane_U32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_set1_epi32((int)a);
+    #elif SIMD_LANES_NEON
+        result.v = vdupq_n_u32(a);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = a;
+    #endif
+    return result;
+}
+
+function Lane_U32 lane_u32_load(u32 *src)
+{
+    Lane_U32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_loadu_si128((__m128i *)src);
+    #elif SIMD_LANES_NEON
+        result.v = vld1q_u32(src);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = src[i];
+    #endif
+    return result;
+}
+
+function void lane_u32_store(u32 *dest, Lane_U32 a)
+{
+    #if SIMD_LANES_SSE2
+        _mm_storeu_si128((__m128i *)dest, a.v);
+    #elif SIMD_LANES_NEON
+        vst1q_u32(dest, a.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) dest[i] = a.v[i];
+    #endif
+}
+
+function Lane_U32 operator&(Lane_U32 a, Lane_U32 b)
+{
+    Lane_U32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_and_si128(a.v, b.v);
+    #elif SIMD_LANES_NEON
+        result.v = vandq_u32(a.v, b.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = a.v[i] & b.v[i];
+    #endif
+    return result;
+}
+
+function Lane_U32 operator|(Lane_U32 a, Lane_U32 b)
+{
+    Lane_U32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_or_si128(a.v, b.v);
+    #elif SIMD_LANES_NEON
+        result.v = vorrq_u32(a.v, b.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = a.v[i] | b.v[i];
+    #endif
+    return result;
+}
+
+function Lane_U32 lane_u32_shl(Lane_U32 a, i32 shift)
+{
+    Lane_U32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_sll_epi32(a.v, _mm_cvtsi32_si128(shift));
+    #elif SIMD_LANES_NEON
+        result.v = vshlq_u32(a.v, vdupq_n_s32(shift));
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = a.v[i] << shift;
+    #endif
+    return result;
+}
+
+// NOTE(nick): truncates towards zero, same as a (u32) cast
+function Lane_U32 lane_u32_from_f32(Lane_F32 a)
+{
+    Lane_U32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_cvttps_epi32(a.v);
+    #elif SIMD_LANES_NEON
+        result.v = vreinterpretq_u32_s32(vcvtq_s32_f32(a.v));
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = (u32)(i32)a.v[i];
+    #endif
+    return result;
+}
+
+// NOTE(nick): picks a where mask is set, b otherwise
+function Lane_U32 lane_u32_select(Lane_U32 mask, Lane_U32 a, Lane_U32 b)
+{
+    Lane_U32 result;
+    #if SIMD_LANES_SSE2
+        result.v = _mm_or_si128(_mm_and_si128(mask.v, a.v), _mm_andnot_si128(mask.v, b.v));
+    #elif SIMD_LANES_NEON
+        result.v = vbslq_u32(mask.v, a.v, b.v);
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result.v[i] = (a.v[i] & mask.v[i]) | (b.v[i] & ~mask.v[i]);
+    #endif
+    return result;
+}
+
+// NOTE(nick): one bit per lane, lane 0 in the lowest bit
+function u32 lane_u32_mask_bits(Lane_U32 mask)
+{
+    u32 result = 0;
+    #if SIMD_LANES_SSE2
+        result = (u32)_mm_movemask_ps(_mm_castsi128_ps(mask.v));
+    #elif SIMD_LANES_NEON
+        const u32 weights[4] = {1, 2, 4, 8};
+        result = vaddvq_u32(vandq_u32(mask.v, vld1q_u32(weights)));
+    #else
+        for (int i = 0; i < LANE_WIDTH; i += 1) result |= (mask.v[i] >> 31) << i;
+    #endif
+    return result;
+}
+
+//
+// API
+//
+
+function void simd_init()
+{
+    g_simd.features = simd__detect_cpu_features();
+
+    g_simd.fill_u32        = simd__fill_u32_scalar;
+    g_simd.fill_u32_stream = simd__fill_u32_scalar;
+
+    g_simd.blend[BlendOp_Copy]     = simd__blend_copy;
+    g_simd.blend[BlendOp_Over]     = simd__blend_over_scalar;
+    g_simd.blend[BlendOp_Add]      = simd__blend_add_scalar;
+    g_simd.blend[BlendOp_Multiply] = simd__blend_multiply_scalar;
+
+    g_simd.tint = simd__tint_scalar;
+
+    g_simd.palette_expand = simd__palette_expand_scalar;
+    g_simd.copy_keyed_u8  = simd__copy_keyed_u8_scalar;
+
+    g_simd.gradient = simd__gradient_scalar;
+
+    g_simd.mix_i16    = simd__mix_i16_scalar;
+    g_simd.mix_peak   = simd__mix_peak_scalar;
+    g_simd.mix_output = simd__mix_output_scalar;
+
+    #if SIMD_X86
+        if (g_simd.features & CPU_SSE2)
+        {
+            g_simd.fill_u32        = simd__fill_u32_sse2;
+            g_simd.fill_u32_stream = simd__fill_u32_stream_sse2;
+
+            g_simd.blend[BlendOp_Over]     = simd__blend_over_sse2;
+            g_simd.blend[BlendOp_Add]      = simd__blend_add_sse2;
+            g_simd.blend[BlendOp_Multiply] = simd__blend_multiply_sse2;
+
+            g_simd.tint = simd__tint_sse2;
+
+            g_simd.copy_keyed_u8 = simd__copy_keyed_u8_sse2;
+
+            g_simd.gradient = simd__gradient_sse2;
+
+            g_simd.mix_i16    = simd__mix_i16_sse2;
+            g_simd.mix_peak   = simd__mix_peak_sse2;
+            g_simd.mix_output = simd__mix_output_sse2;
+        }
+
+        if (g_simd.features & CPU_AVX2)
+        {
+            g_simd.fill_u32        = simd__fill_u32_avx2;
+            g_simd.fill_u32_stream = simd__fill_u32_stream_avx2;
+
+            g_simd.blend[BlendOp_Over]     = simd__blend_over_avx2;
+            g_simd.blend[BlendOp_Add]      = simd__blend_add_avx2;
+            g_simd.blend[BlendOp_Multiply] = simd__blend_multiply_avx2;
+
+            g_simd.tint = simd__tint_avx2;
+
+            g_simd.palette_expand = simd__palette_expand_avx2;
+            g_simd.copy_keyed_u8  = simd__copy_keyed_u8_avx2;
+
+            g_simd.mix_i16 = simd__mix_i16_avx2;
+        }
+    #endif
+
+    #if SIMD_NEON
+        // NOTE(nick): there's no portable non-temporal store intrinsic on ARM, regular stores are the best we have
+        g_simd.fill_u32        = simd__fill_u32_neon;
+        g_simd.fill_u32_stream = simd__fill_u32_neon;
+
+        g_simd.blend[BlendOp_Over]     = simd__blend_over_neon;
+        g_simd.blend[BlendOp_Add]      = simd__blend_add_neon;
+        g_simd.blend[BlendOp_Multiply] = simd__blend_multiply_neon;
+
+        g_simd.tint = simd__tint_neon;
+
+        // NOTE(nick): table lookups only reach 64 bytes, so the palette stays scalar
+        g_simd.copy_keyed_u8 = simd__copy_keyed_u8_neon;
+
+        g_simd.gradient = simd__gradient_neon;
+
+        g_simd.mix_i16    = simd__mix_i16_neon;
+        g_simd.mix_peak   = simd__mix_peak_neon;
+        g_simd.mix_output = simd__mix_output_neon;
+    #endif
+}
+
+function void simd_fill_u32(u32 *dest, u32 value, i64 count)
+{
+    g_simd.fill_u32(dest, value, count);
+}
+
+function void simd_fill_u32_stream(u32 *dest, u32 value, i64 count)
+{
+    g_simd.fill_u32_stream(dest, value, count);
+}
+
+function void simd_blend(Blend_Op op, u32 *dest, u32 *src, i64 count)
+{
+    g_simd.blend[op](dest, src, count);
+}
+
+// NOTE(nick): dest and src may be the same buffer
+function void simd_tint(u32 *dest, u32 *src, i64 count, u32 tint)
+{
+    g_simd.tint(dest, src, count, tint);
+}
+
+function void simd_palette_expand(u32 *dest, u8 *src, i64 count, u32 *palette)
+{
+    g_simd.palette_expand(dest, src, count, palette);
+}
+
+// NOTE(nick): copies every byte of src that isn't zero
+function void simd_copy_keyed_u8(u8 *dest, u8 *src, i64 count)
+{
+    g_simd.copy_keyed_u8(dest, src, count);
+}
+
+function void simd_gradient(u32 *dest, i64 count, i32 *start, i32 *step)
+{
+    g_simd.gradient(dest, count, start, step);
+}
+
+// NOTE(nick): dest += src * gain, count is in samples
+function void simd_mix_i16(f32 *dest, i16 *src, i64 count, f32 gain)
+{
+    g_simd.mix_i16(dest, src, count, gain);
+}
+
+// NOTE(nick): largest absolute value in src
+function f32 simd_mix_peak(f32 *src, i64 count)
+{
+    return g_simd.mix_peak(src, count);
+}
+
+function void simd_mix_output(i16 *dest, f32 *src, i64 frame_count, f32 gain, f32 gain_step)
+{
+    g_simd.mix_output(dest, src, frame_count, gain, gain_step);
+}
+
+function void simd_blend_color(Blend_Op op, u32 *dest, u32 color, i64 count)
+{
+    if (op == BlendOp_Copy)
+    {
+        g_simd.fill_u32(dest, color, count);
+        return;
+    }
+
+    u32 src[64];
+    g_simd.fill_u32(src, color, Min(count, count_of(src)));
+
+    while (count > 0)
+    {
+        i64 n = Min(count, count_of(src));
+        g_simd.blend[op](dest, src, n);
+
+        dest  += n;
+        count -= n;
+    }
+}
+
+// NOTE(nick): blends one pixel without going through a kernel, for scattered writes like lines
+function void simd_blend_pixel(Blend_Op op, u32 *dest, u32 color)
+{
+    if (op == BlendOp_Copy)
+    {
+        *dest = color;
+        return;
+    }
+
+    if (op == BlendOp_Over)
+    {
+        *dest = simd__over_pixel(*dest, color);
+        return;
+    }
+
+    g_simd.blend[op](dest, &color, 1);
+}
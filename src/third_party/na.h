@@ -1417,6 +1417,7 @@ function u64 atomic_add_u64(u64 volatile *value, u64 Addend);
 
 // Threads
 function u64 os_thread_get_id();
+function u32 os_processor_count();
 function Thread os_thread_create(Thread_Proc *proc, void *data, u64 copy_size);
 function void os_thread_pause(Thread thread);
 function void os_thread_resume(Thread thread);
@@ -1470,6 +1471,7 @@ struct Worker_Params
 
 function void work_queue_init(Work_Queue *queue, u64 thread_count);
 function void work_queue_add_entry(Work_Queue *queue, Worker_Proc *callback, void *data);
+function void work_queue_complete_all_work(Work_Queue *queue);
 
 //
 // Platform-Specific Headers:
@@ -5258,6 +5260,12 @@ function u64 os_thread_get_id() {
     return (u64)result;
 }
 
+function u32 os_processor_count() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return Max(info.dwNumberOfProcessors, 1);
+}
+
 function u32 atomic_compare_exchange_u32(u32 volatile *value, u32 New, u32 Expected) {
     u32 result = _InterlockedCompareExchange((long volatile *)value, New, Expected);
     return (result);
@@ -6422,6 +6430,12 @@ function u64 os_thread_get_id()
     return (u64)self;
 }
 
+function u32 os_processor_count()
+{
+    i64 result = sysconf(_SC_NPROCESSORS_ONLN);
+    return (u32)Max(result, 1);
+}
+
 function Thread os_thread_create(Thread_Proc *proc, void *data, u64 copy_size)
 {
     Unix_Thread_Params *params = (Unix_Thread_Params *)os_alloc(AlignUpPow2(sizeof(Unix_Thread_Params), 64) + copy_size);
@@ -6756,6 +6770,17 @@ function void work_queue_add_entry(Work_Queue *queue, Worker_Proc *callback, voi
     os_semaphore_signal(&queue->semaphore);
 }
 
+function void work_queue_complete_all_work(Work_Queue *queue)
+{
+    // NOTE(nick): the calling thread helps out until every entry is done
+    while (queue->completion_goal != queue->completion_count) {
+        os__do_next_work_queue_entry(queue);
+    }
+
+    queue->completion_goal = 0;
+    queue->completion_count = 0;
+}
+
 
 //
 // Array macros for partial functionality: